@@ -0,0 +1,487 @@
+#include "BenchSupport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "InputLog.h"
+
+char const *GENERATOR_USAGE =
+	"  [--mode recursive|batched|incremental|budgeted] [--threads N] [--parallel-depth N]\n"
+	"  [--frustum-planes] [--budget-tiles N] [--budget-us N] [--async] [--huge-pages] [--terrain]\n"
+	"  [--pyramid FILE [--loader [--load-latency US] [--load-budget MB] [--load-threads N]]]\n";
+
+char const *SUITE_USAGE =
+	"--suite DIR [--baseline FILE] [--write-baseline] [--repeat N]\n"
+	"  [--time-tolerance PERCENT] [--p99-tolerance PERCENT] [--tile-tolerance PERCENT]";
+
+// p99 changes smaller than this are timer and scheduler noise whatever the
+// percentage, the cheapest scenarios take a couple of microseconds a frame
+constexpr double MIN_P99_CHANGE_US = 5;
+// The reference workload, its fastest burst is the one a suite goes by
+constexpr int REFERENCE_POINTS = 1 << 16;
+constexpr int REFERENCE_BURSTS = 5;
+
+// Mouse sweeps once around the origin at a fixed height
+static void runOrbit(OrbitCamera &camera, int frames, FrameFunction const &frame)
+	{
+	for (int i = 0; i < frames; ++i)
+		{
+		camera.setMousePosition(i * WINDOW_WIDTH / frames, WINDOW_HEIGHT / 2);
+		frame();
+		}
+	}
+
+// Left button held to zoom all the way in, then the right one to zoom back out
+static void runZoom(OrbitCamera &camera, int frames, FrameFunction const &frame)
+	{
+	camera.setMousePosition(WINDOW_WIDTH / 3, WINDOW_HEIGHT * 3 / 4);
+	camera.setMouseButton(ORBIT_LEFT_BUTTON, true);
+	for (int i = 0; i < frames / 2; ++i)
+		frame();
+	camera.setMouseButton(ORBIT_LEFT_BUTTON, false);
+	camera.setMouseButton(ORBIT_RIGHT_BUTTON, true);
+	for (int i = frames / 2; i < frames; ++i)
+		frame();
+	camera.setMouseButton(ORBIT_RIGHT_BUTTON, false);
+	}
+
+// Orbit tuples from overhead down to grazing, closing in and raising the
+// detail as it goes
+static void runSweep(OrbitCamera &camera, int frames, FrameFunction const &frame)
+	{
+	for (int i = 0; i < frames; ++i)
+		{
+		float t = float(i) / std::max(frames - 1, 1);
+		camera.setOrbit(t * 0.5f, 0.05f + t * 0.9f, 10.f - t * 9.f, 0.4f - t * 0.35f);
+		frame();
+		}
+	}
+
+bool runCameraPath(OrbitCamera &camera, std::string const &path, int frames, FrameFunction const &frame)
+	{
+	if (path == "orbit")
+		runOrbit(camera, frames, frame);
+	else if (path == "zoom")
+		runZoom(camera, frames, frame);
+	else if (path == "sweep")
+		runSweep(camera, frames, frame);
+	else
+		return false;
+	return true;
+	}
+
+bool runCameraScript(OrbitCamera &camera, char const *path, FrameFunction const &frame)
+	{
+	std::ifstream file(path);
+	if (!file)
+		{
+		fprintf(stderr, "could not read script %s\n", path);
+		return false;
+		}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+		{
+		++lineNumber;
+		line = line.substr(0, line.find('#'));
+		std::istringstream words(line);
+		std::string command;
+		if (!(words >> command))
+			continue;
+
+		bool ok = true;
+		if (command == "mouse")
+			{
+			int x, y;
+			ok = bool(words >> x >> y);
+			if (ok)
+				camera.setMousePosition(x, y);
+			}
+		else if (command == "button")
+			{
+			int button;
+			std::string state;
+			ok = (words >> button >> state) && (state == "down" || state == "up");
+			if (ok)
+				camera.setMouseButton(button, state == "down");
+			}
+		else if (command == "orbit")
+			{
+			float orbitXZ, orbitYZ, distance, detail;
+			ok = bool(words >> orbitXZ >> orbitYZ >> distance >> detail);
+			if (ok)
+				camera.setOrbit(orbitXZ, orbitYZ, distance, detail);
+			}
+		else if (command == "frame")
+			{
+			int count = 1;
+			words >> count;
+			for (int i = 0; i < count; ++i)
+				frame();
+			}
+		else
+			ok = false;
+
+		if (!ok)
+			{
+			fprintf(stderr, "%s:%d: can't parse '%s'\n", path, lineNumber, line.c_str());
+			return false;
+			}
+		}
+	return true;
+	}
+
+// Reruns input recorded in the window with --record-input, one frame per
+// frame the window drew
+bool runInputReplay(OrbitCamera &camera, char const *path, FrameFunction const &frame)
+	{
+	InputReplay replay;
+	if (!replay.load(path))
+		return false;
+
+	for (int i = 0; i < replay.frames(); ++i)
+		{
+		replay.apply(i, camera);
+		frame();
+		}
+	return true;
+	}
+
+// Takes argv[i] (and its value) if it's a generator option; false if it
+// isn't one or its value is bad
+bool GeneratorOptions::parse(int argc, char* argv[], int &i)
+	{
+	if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+		{
+		std::string name = argv[++i];
+		if (name == "recursive")
+			mode = TraversalMode::Recursive;
+		else if (name == "batched")
+			mode = TraversalMode::Batched;
+		else if (name == "incremental")
+			mode = TraversalMode::Incremental;
+		else if (name == "budgeted")
+			mode = TraversalMode::Budgeted;
+		else
+			return false;
+		}
+	else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		threads = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--parallel-depth") == 0 && i + 1 < argc)
+		parallelDepth = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--frustum-planes") == 0)
+		cullMode = CullMode::FrustumPlanes;
+	else if (strcmp(argv[i], "--budget-tiles") == 0 && i + 1 < argc)
+		tileBudget = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--budget-us") == 0 && i + 1 < argc)
+		timeBudget = atoi(argv[++i]);
+	else if (strcmp(argv[i], "--async") == 0)
+		async = true;
+	else if (strcmp(argv[i], "--huge-pages") == 0)
+		hugePages = true;
+	else if (strcmp(argv[i], "--terrain") == 0)
+		terrain = true;
+	else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc)
+		{
+		auto opened = std::make_shared<TilePyramid>();
+		if (!opened->open(argv[++i]))
+			{
+			fprintf(stderr, "could not open tile pyramid %s\n", argv[i]);
+			return false;
+			}
+		pyramid = opened;
+		}
+	else if (strcmp(argv[i], "--loader") == 0)
+		loader = true;
+	else if (strcmp(argv[i], "--load-latency") == 0 && i + 1 < argc)
+		{
+		loadLatency = atoi(argv[++i]);
+		loadTuned = true;
+		}
+	else if (strcmp(argv[i], "--load-budget") == 0 && i + 1 < argc)
+		{
+		loadBudget = atoi(argv[++i]);
+		loadTuned = true;
+		}
+	else if (strcmp(argv[i], "--load-threads") == 0 && i + 1 < argc)
+		{
+		loadThreads = atoi(argv[++i]);
+		loadTuned = true;
+		}
+	else
+		return false;
+	return true;
+	}
+
+bool GeneratorOptions::validate() const
+	{
+	if (loader && !pyramid)
+		{
+		fprintf(stderr, "--loader needs a --pyramid before it\n");
+		return false;
+		}
+	if (loadTuned && !loader)
+		{
+		fprintf(stderr, "--load-latency, --load-budget and --load-threads need --loader\n");
+		return false;
+		}
+	return true;
+	}
+
+// Sampled once and shared, building it takes a moment
+std::shared_ptr<Heightfield const> terrainHeightfield()
+	{
+	static auto heightfield = std::make_shared<Heightfield const>(ProceduralTerrain());
+	return heightfield;
+	}
+
+void GeneratorOptions::apply(TileGenerator &generator) const
+	{
+	generator.setTraversalMode(mode);
+	generator.setCullMode(cullMode);
+	if (threads > 0)
+		generator.setTraversalThreads(threads);
+	generator.setParallelDepth(parallelDepth);
+	generator.setRefineBudget(tileBudget, timeBudget);
+	setHugePages(hugePages);
+	if (pyramid)
+		{
+		generator.setTilePyramid(pyramid);
+		// a loader per generator, so every scenario starts with nothing resident
+		if (loader)
+			generator.setTileLoader(std::make_shared<TileLoader>(std::make_shared<PyramidTileSource const>(pyramid, loadLatency),
+				size_t(std::max(loadBudget, 0)) << 20, loadThreads));
+		}
+	else
+		generator.setHeightfield(terrain ? terrainHeightfield() : nullptr);
+	generator.setAsyncGeneration(async);
+	}
+
+// The heightfield itself, or for a pyramid the depth with about a
+// heightfield's worth of samples. Tiles finer than that are culled against
+// the pyramid's full resolution ranges but drawn on the coarser surface.
+std::shared_ptr<Heightfield const> GeneratorOptions::drawnHeightfield() const
+	{
+	if (pyramid)
+		return std::make_shared<Heightfield const>(PyramidLevel(*pyramid, pyramid->depthForCells(1 << DEFAULT_HEIGHTFIELD_LEVELS)));
+	return terrain ? terrainHeightfield() : nullptr;
+	}
+
+bool SuiteOptions::parse(int argc, char* argv[], int &i)
+	{
+	if (strcmp(argv[i], "--suite") == 0 && i + 1 < argc)
+		directory = argv[++i];
+	else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+		baseline = argv[++i];
+	else if (strcmp(argv[i], "--write-baseline") == 0)
+		writeBaseline = true;
+	else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+		repeat = std::max(atoi(argv[++i]), 1);
+	else if (strcmp(argv[i], "--time-tolerance") == 0 && i + 1 < argc)
+		timeTolerance = atof(argv[++i]);
+	else if (strcmp(argv[i], "--p99-tolerance") == 0 && i + 1 < argc)
+		p99Tolerance = atof(argv[++i]);
+	else if (strcmp(argv[i], "--tile-tolerance") == 0 && i + 1 < argc)
+		tileTolerance = atof(argv[++i]);
+	else
+		return false;
+	return true;
+	}
+
+static bool readBaseline(std::string const &path, std::vector<ScenarioResult> &baseline)
+	{
+	auto file = fopen(path.c_str(), "r");
+	if (!file)
+		{
+		fprintf(stderr, "could not read baseline %s\n", path.c_str());
+		return false;
+		}
+
+	char line[256], name[128];
+	while (fgets(line, sizeof(line), file))
+		{
+		ScenarioResult result;
+		if (line[0] == '#' || sscanf(line, "%127s %lf %lf %lf %lf %lf", name, &result.nodesPerFrame, &result.tilesPerFrame,
+				&result.nodesPerSecond, &result.p99Microseconds, &result.referenceMicroseconds) != 6)
+			continue;
+		result.name = name;
+		baseline.push_back(result);
+		}
+	fclose(file);
+	return true;
+	}
+
+static bool writeBaseline(std::string const &path, std::vector<ScenarioResult> const &results, int argc, char* argv[])
+	{
+	auto file = fopen(path.c_str(), "w");
+	if (!file)
+		{
+		fprintf(stderr, "could not write baseline %s\n", path.c_str());
+		return false;
+		}
+
+	fprintf(file, "# Suite baseline, the timings only hold for the machine that wrote it\n#");
+	for (int i = 0; i < argc; ++i)
+		fprintf(file, " %s", argv[i]);
+	fprintf(file, "\n# scenario nodesPerFrame tilesPerFrame nodesPerSecond p99Microseconds referenceMicroseconds\n");
+	for (auto &result : results)
+		fprintf(file, "%s %.2f %.2f %.0f %.1f %.1f\n", result.name.c_str(), result.nodesPerFrame, result.tilesPerFrame,
+			result.nodesPerSecond, result.p99Microseconds, result.referenceMicroseconds);
+	fclose(file);
+	return true;
+	}
+
+static double percentChange(double measured, double baseline)
+	{
+	return baseline == 0 ? (measured == 0 ? 0 : HUGE_VAL) : (measured / baseline - 1) * 100;
+	}
+
+// A fixed piece of work that doesn't run any of the code being measured:
+// points through a projection and a clip test, the same kind of math the
+// traversal does. How long it takes right next to a pass is how fast the
+// machine is running then.
+static double referenceMicroseconds()
+	{
+	static int volatile sink;
+	auto viewProj = glm::perspective(1.f, 16.f / 9.f, 0.1f, 100.f) * glm::lookAt(glm::vec3(3, 5, 7), glm::vec3(0), glm::vec3(0, 1, 0));
+	auto best = HUGE_VAL;
+	for (int burst = 0; burst < REFERENCE_BURSTS; ++burst)
+		{
+		auto start = std::chrono::steady_clock::now();
+		int inside = 0;
+		for (int i = 0; i < REFERENCE_POINTS; ++i)
+			{
+			auto clip = viewProj * glm::vec4(float(i & 255) * 0.02f - 2.56f, float(burst), float(i >> 8) * 0.02f - 2.56f, 1.f);
+			inside += std::fabs(clip.x) < clip.w && std::fabs(clip.y) < clip.w;
+			}
+		sink = inside;
+		best = std::min(best, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		}
+	return best;
+	}
+
+static double median(std::vector<double> values)
+	{
+	std::sort(values.begin(), values.end());
+	auto middle = values.size() / 2;
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+	}
+
+// Runs each scenario in the baseline (or with writeBaseline every script in
+// the directory) repeat times, and fails if nodes visited or tiles per frame
+// changed either way by more than tileTolerance, which means the traversal
+// or the tiles themselves changed. Raw timings drift by a third from run to
+// run on the same build, and further between the machine's good and bad
+// moments, so each pass is timed against the reference workload run just
+// before it and the suite compares the median of those ratios: nodes/sec
+// down by more than timeTolerance, or p99 frame time up by more than
+// p99Tolerance and MIN_P99_CHANGE_US at the reference's current speed,
+// fails. Over 30 suite runs of one build nodes/sec stayed within 29% of
+// the baseline, p99 within 56% where it's over the minimum change; running
+// the traversal twice a frame failed every scenario.
+// Scenarios are the .txt scripts in the directory, baselines excepted.
+int runSuite(SuiteOptions const &suite, std::string const &baselineName, ScenarioFunction const &run, int argc, char* argv[])
+	{
+	auto baselinePath = suite.baseline.empty() ? suite.directory + "/" + baselineName : suite.baseline;
+	std::vector<ScenarioResult> baseline;
+	if (suite.writeBaseline)
+		{
+		for (auto &entry : std::filesystem::directory_iterator(suite.directory))
+			if (entry.path().extension() == ".txt" && entry.path().stem().string().find("baseline") == std::string::npos)
+				baseline.push_back({ entry.path().stem().string(), 0, 0, 0, 0, 0 });
+		std::sort(baseline.begin(), baseline.end(), [](ScenarioResult const &a, ScenarioResult const &b) { return a.name < b.name; });
+		}
+	else if (!readBaseline(baselinePath, baseline))
+		return 1;
+
+	std::vector<ScenarioResult> results;
+	int regressions = 0;
+	printf("%-16s %22s %9s %22s %9s %22s %9s %22s\n", "scenario", "nodes/frame (baseline)", "", "tiles/frame (baseline)", "", "nodes/s (baseline)", "", "p99 us (baseline)");
+	for (auto &expected : baseline)
+		{
+		// the timings are kept in reference runs (node rate) and reference
+		// times (p99) until the end, then put back in microseconds at the
+		// reference's median speed
+		ScenarioResult result = { expected.name, 0, 0, 0, 0, 0 };
+		std::vector<double> rates, p99s, references;
+		for (int i = 0; i < suite.repeat; ++i)
+			{
+			ScenarioResult pass;
+			auto reference = referenceMicroseconds();
+			if (!run(suite.directory + "/" + expected.name + ".txt", pass))
+				return 1;
+			result.nodesPerFrame = pass.nodesPerFrame;
+			result.tilesPerFrame = pass.tilesPerFrame;
+			rates.push_back(pass.nodesPerSecond * reference);
+			p99s.push_back(pass.p99Microseconds / reference);
+			references.push_back(reference);
+			}
+		result.referenceMicroseconds = median(references);
+		result.nodesPerSecond = median(rates) / result.referenceMicroseconds;
+		result.p99Microseconds = median(p99s) * result.referenceMicroseconds;
+		results.push_back(result);
+		if (suite.writeBaseline)
+			{
+			printf("%-16s %22.2f %9s %22.2f %9s %22.0f %9s %22.1f\n", result.name.c_str(), result.nodesPerFrame, "", result.tilesPerFrame, "", result.nodesPerSecond, "", result.p99Microseconds);
+			continue;
+			}
+
+		// the baseline's timings at the speed the reference ran at here
+		auto speed = expected.referenceMicroseconds / result.referenceMicroseconds;
+		auto expectedRate = expected.nodesPerSecond * speed,
+			expectedP99 = expected.p99Microseconds / speed;
+		auto nodes = percentChange(result.nodesPerFrame, expected.nodesPerFrame),
+			tiles = percentChange(result.tilesPerFrame, expected.tilesPerFrame),
+			rate = percentChange(result.nodesPerSecond, expectedRate),
+			p99 = percentChange(result.p99Microseconds, expectedP99);
+		auto failed = std::fabs(nodes) > suite.tileTolerance || std::fabs(tiles) > suite.tileTolerance ||
+			(suite.timeTolerance > 0 && (rate < -suite.timeTolerance ||
+				(p99 > suite.p99Tolerance && result.p99Microseconds - expectedP99 > MIN_P99_CHANGE_US)));
+		regressions += failed;
+
+		char nodesText[64], tilesText[64], rateText[64], p99Text[64];
+		snprintf(nodesText, sizeof(nodesText), "%.2f (%.2f)", result.nodesPerFrame, expected.nodesPerFrame);
+		snprintf(tilesText, sizeof(tilesText), "%.2f (%.2f)", result.tilesPerFrame, expected.tilesPerFrame);
+		snprintf(rateText, sizeof(rateText), "%.0f (%.0f)", result.nodesPerSecond, expectedRate);
+		snprintf(p99Text, sizeof(p99Text), "%.1f (%.1f)", result.p99Microseconds, expectedP99);
+		printf("%-16s %22s %+8.1f%% %22s %+8.1f%% %22s %+8.1f%% %22s %+8.1f%% %s\n", result.name.c_str(),
+			nodesText, nodes, tilesText, tiles, rateText, rate, p99Text, p99, failed ? "REGRESSED" : "ok");
+		}
+
+	if (suite.writeBaseline)
+		return writeBaseline(baselinePath, results, argc, argv) ? 0 : 1;
+
+	printf("%d of %zu scenarios regressed\n", regressions, baseline.size());
+	return regressions > 0 ? 1 : 0;
+	}
+
+void AllocationSummary::add(int allocations)
+	{
+	if (allocations > 0)
+		{
+		++allocatingFrames;
+		lastAllocatingFrame = frames;
+		}
+	total += allocations;
+	max = std::max(max, allocations);
+	++frames;
+	}
+
+void AllocationSummary::print() const
+	{
+	printf("allocations %lld max %d per frame, %d of %d frames allocated, last frame %d\n", total, max, allocatingFrames, frames, lastAllocatingFrame);
+	}
+
+float percentile(std::vector<float> const &sorted, float p)
+	{
+	if (sorted.empty())
+		return 0;
+	auto index = size_t(p * (sorted.size() - 1) + 0.5f);
+	return sorted[std::min(index, sorted.size() - 1)];
+	}
@@ -0,0 +1,103 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "OrbitCamera.h"
+#include "TileGenerator.h"
+
+// Shared by the bench drivers: camera paths, generator options and stats.
+//
+// Script lines, '#' starts a comment:
+//   mouse X Y                       like a mouse move event, window pixels
+//   button B down|up                like a mouse button event, 0 left, 2 right, 3/4 wheel
+//   orbit XZ YZ DISTANCE DETAIL     places the camera directly
+//   frame [N]                       renders N frames, default 1
+
+typedef std::function<void()> FrameFunction;
+
+bool runCameraPath(OrbitCamera &camera, std::string const &path, int frames, FrameFunction const &frame);
+bool runCameraScript(OrbitCamera &camera, char const *path, FrameFunction const &frame);
+bool runInputReplay(OrbitCamera &camera, char const *path, FrameFunction const &frame);
+
+// Generator settings given on the command line, applied once parsing is
+// done; kept rather than set straight away so a suite can apply them to a
+// fresh generator per scenario
+struct GeneratorOptions
+	{
+	TraversalMode mode = TraversalMode::Recursive;
+	CullMode cullMode = CullMode::ClipSpace;
+	int threads = 0,		// 0 leaves the generator's default, a thread per core
+		parallelDepth = DEFAULT_PARALLEL_DEPTH,
+		tileBudget = 0,
+		timeBudget = 0;
+	bool async = false,
+		hugePages = false,
+		terrain = false;		// the ProceduralTerrain heightfield, see terrainHeightfield
+	std::shared_ptr<TilePyramid const> pyramid;	// --pyramid, opened while parsing
+	bool loader = false;	// refine only into pyramid tiles a TileLoader has loaded
+	int loadLatency = 0,	// microseconds per tile, the stand-in service's round trip
+		loadBudget = DEFAULT_LOAD_BUDGET_MB,
+		loadThreads = DEFAULT_LOAD_THREADS;
+	bool loadTuned = false;	// any of --load-latency, --load-budget, --load-threads
+
+	bool parse(int argc, char* argv[], int &i);
+	// Checks the options that only make sense together, once they're all parsed
+	bool validate() const;
+	void apply(TileGenerator &generator) const;
+	// What a renderer should draw the terrain with, null for the flat quad
+	std::shared_ptr<Heightfield const> drawnHeightfield() const;
+	};
+
+extern char const *GENERATOR_USAGE;
+
+std::shared_ptr<Heightfield const> terrainHeightfield();
+
+// What a suite compares a scenario on, from one pass over its script. The
+// per frame counts are the same on every run of a script, the timings are
+// not; runSuite times a fixed reference workload next to each pass and
+// compares them against that.
+struct ScenarioResult
+	{
+	std::string name;
+	double nodesPerFrame;
+	double tilesPerFrame;
+	double nodesPerSecond;
+	double p99Microseconds;
+	double referenceMicroseconds;	// filled in by runSuite
+	};
+
+typedef std::function<bool(std::string const &script, ScenarioResult &result)> ScenarioFunction;
+
+struct SuiteOptions
+	{
+	std::string directory,		// --suite, empty when not running one
+		baseline;				// default DIRECTORY/the bench's baseline name
+	bool writeBaseline = false;
+	int repeat = 9;
+	double timeTolerance = 40,	// percent, nodes/sec relative to the reference; 0 only reports the timings
+		p99Tolerance = 100,		// percent, p99 frame time the same way, it's the noisier of the two
+		tileTolerance = 1;		// percent, nodes visited and tiles per frame
+
+	bool parse(int argc, char* argv[], int &i);
+	};
+
+extern char const *SUITE_USAGE;
+
+int runSuite(SuiteOptions const &suite, std::string const &baselineName, ScenarioFunction const &run, int argc, char* argv[]);
+
+float percentile(std::vector<float> const &sorted, float p);
+
+// Heap allocations per frame, from AllocationCounter; once warmed up a frame
+// shouldn't allocate, so the summary says when the last one that did was
+struct AllocationSummary
+	{
+	long long total = 0;
+	int frames = 0,
+		allocatingFrames = 0,
+		lastAllocatingFrame = -1,
+		max = 0;
+
+	void add(int allocations);
+	void print() const;
+	};
@@ -0,0 +1,80 @@
+#include "OffscreenContext.h"
+#include <EGL/eglext.h>
+#include <stdio.h>
+
+OffscreenContext::~OffscreenContext()
+{
+	if (_framebuffer)
+		{
+		glDeleteFramebuffers(1, &_framebuffer);
+		glDeleteRenderbuffers(2, _renderbuffers);
+		}
+	if (_context != EGL_NO_CONTEXT)
+		{
+		eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(_display, _context);
+		}
+	if (_display != EGL_NO_DISPLAY)
+		eglTerminate(_display);
+}
+
+// Makes a 3.3 context current with a width x height colour and depth
+// framebuffer bound
+bool OffscreenContext::create(int width, int height, bool coreProfile)
+	{
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (_display == EGL_NO_DISPLAY)
+		_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, &major, &minor))
+		{
+		fprintf(stderr, "could not initialize EGL\n");
+		return false;
+		}
+
+	eglBindAPI(EGL_OPENGL_API);
+	EGLint attributes[] =
+		{
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, coreProfile ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+		};
+	// No surface, so no config needed (EGL_KHR_no_config_context)
+	_context = eglCreateContext(_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (_context == EGL_NO_CONTEXT || !eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context))
+		{
+		fprintf(stderr, "could not create a surfaceless GL 3.3 context (error 0x%x)\n", eglGetError());
+		return false;
+		}
+
+	_width = width;
+	_height = height;
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glGenRenderbuffers(2, _renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, _renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _renderbuffers[1]);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+		fprintf(stderr, "offscreen framebuffer incomplete\n");
+		return false;
+		}
+	glViewport(0, 0, width, height);
+	return true;
+	}
+
+// Bottom row first, as GL returns it
+void OffscreenContext::readPixels(void *rgba) const
+	{
+	glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+	}
@@ -0,0 +1,23 @@
+#pragma once
+#include <EGL/egl.h>
+#include "GLPlatform.h"
+
+// A GL context with no window: EGL on Mesa's surfaceless platform (llvmpipe
+// when there's no GPU), rendering into a framebuffer object of the window's
+// size
+class OffscreenContext
+{
+public:
+	~OffscreenContext();
+
+	bool create(int width, int height, bool coreProfile);
+	void readPixels(void *rgba) const;
+
+private:
+	EGLDisplay _display = EGL_NO_DISPLAY;
+	EGLContext _context = EGL_NO_CONTEXT;
+	GLuint _framebuffer = 0;
+	GLuint _renderbuffers[2] = {};
+	int _width = 0,
+		_height = 0;
+};
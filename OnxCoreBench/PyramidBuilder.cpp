@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "MappedFile.h"
+#include "SampleBatch.h"
+#include "TaskPool.h"
+#include "TilePyramid.h"
+
+// Offline builder for TilePyramid files. The finest depth is cut into
+// stripes 2^STRIPE_DEPTHS tiles across at most, each streamed from
+// the heightmap a row of tiles at a time: the band of source rows under
+// the row is converted to floats, resampled onto the tiles, and every
+// second row the pair is averaged into the row above, and so on up to the
+// stripe's root. Whatever has been written is let go of straight away, the
+// output is mapped and fills in where it's written, so memory stays at a
+// band and a couple of tile rows per depth of one stripe however big the
+// heightmap is. The depths above the stripes are built last the same way.
+// Each row's tiles are tasks on the pool.
+
+// Depths below a stripe's root, so 64 finest tiles across
+constexpr int STRIPE_DEPTHS = 6;
+
+struct Heightmap
+	{
+	MappedFile file;
+	int width = 0,
+		height = 0;
+	bool floats = false;	// 32 bit floats rather than 16 bit unsigned
+	float scale = 1.f / 65535.f,
+		offset = 0.f;
+
+	size_t sampleBytes() const { return floats ? sizeof(float) : sizeof(uint16_t); }
+	size_t rowBytes() const { return size_t(width) * sampleBytes(); }
+
+	// count elevations of row y from column x
+	void convert(int x, int y, int count, float *out) const
+		{
+		auto in = file.data() + (size_t(y) * width + x) * sampleBytes();
+		if (!floats)
+			{
+			convertBatch(reinterpret_cast<uint16_t const *>(in), size_t(count), scale, offset, out);
+			return;
+			}
+		for (int i = 0; i < count; ++i)
+			{
+			float value;
+			memcpy(&value, in + i * sizeof(float), sizeof(value));
+			out[i] = value * scale + offset;
+			}
+		}
+	};
+
+// Elevations of a window of the heightmap, converted once for all the
+// tiles that resample it
+struct Band
+	{
+	std::vector<float> samples;
+	int firstColumn = 0,
+		firstRow = 0,
+		columns = 0,
+		rows = 0;
+
+	float const *row(int y) const { return samples.data() + size_t(y - firstRow) * columns; }
+	};
+
+struct PyramidBuilder
+	{
+	Heightmap const *source = nullptr;
+	TaskPool *pool = nullptr;
+	PyramidHeader header = {};
+	MappedFile output;
+	Band band;
+	bool sameGrid = false;	// the heightmap's samples are the finest depth's, nothing to resample
+
+	// Per worker, so the tasks don't allocate once they've warmed up
+	struct Scratch
+		{
+		std::vector<float> rows;
+		std::vector<int> lower, upper;
+		std::vector<float> weight;
+		};
+	std::vector<Scratch> scratch;
+
+	int finest() const { return int(header.Levels) - 1; }
+	int side() const { return int(header.TileCells) + 1; }
+	double cells() const { return double(header.TileCells) * double(1u << finest()); }
+	PyramidEntry *table() const { return reinterpret_cast<PyramidEntry *>(output.data() + header.TableOffset); }
+	PyramidEntry &entry(glm::uvec2 const &cell, int depth) const { return table()[pyramidEntryIndex(cell, depth)]; }
+	float *block(glm::uvec2 const &cell, int depth) const
+		{
+		return reinterpret_cast<float *>(output.data() + entry(cell, depth).Offset);
+		}
+
+	// Heightmap coordinates of finest grid sample i along an axis with
+	// size samples, clamped; the same doubles every time so the band and
+	// the resampling agree on which samples are needed
+	double sourceAt(int64_t i, int size) const
+		{
+		return std::min(std::max(double(i) / cells(), 0.0), 1.0) * (size - 1);
+		}
+	static int lowerSample(double x, int size) { return std::min(int(x), size - 2 < 0 ? 0 : size - 2); }
+	static int upperSample(double x, int size) { return std::min(lowerSample(x, size) + 1, size - 1); }
+
+	// Converts the heightmap under finest tiles first to first + count - 1
+	// of a row, a task per few rows
+	void loadBand(glm::uvec2 const &first, unsigned count)
+		{
+		auto cellsPerTile = int64_t(header.TileCells);
+		auto x0 = sourceAt(first.x * cellsPerTile, source->width),
+			x1 = sourceAt((first.x + count) * cellsPerTile, source->width),
+			y0 = sourceAt(first.y * cellsPerTile, source->height),
+			y1 = sourceAt((first.y + 1) * cellsPerTile, source->height);
+		band.firstColumn = lowerSample(x0, source->width);
+		band.firstRow = lowerSample(y0, source->height);
+		band.columns = upperSample(x1, source->width) - band.firstColumn + 1;
+		band.rows = upperSample(y1, source->height) - band.firstRow + 1;
+		band.samples.resize(size_t(band.columns) * band.rows);
+
+		constexpr int ROWS_PER_TASK = 16;
+		for (int row = 0; row < band.rows; row += ROWS_PER_TASK)
+			pool->push([this, row](int)
+				{
+				for (int y = row; y < std::min(row + ROWS_PER_TASK, band.rows); ++y)
+					source->convert(band.firstColumn, band.firstRow + y, band.columns, band.samples.data() + size_t(y) * band.columns);
+				});
+		pool->run();
+		}
+
+	// The band's columns of heightmap rows, a call per row since they're
+	// a row apart in the file
+	void readAhead(int firstRow, int rows) const
+		{
+		for (auto y = firstRow; y < std::min(firstRow + rows, source->height); ++y)
+			source->file.willNeed(size_t(y) * source->rowBytes() + size_t(band.firstColumn) * source->sampleBytes(),
+				size_t(band.columns) * source->sampleBytes());
+		}
+	void releaseRows(int firstRow, int rows) const
+		{
+		for (auto y = firstRow; y < firstRow + rows; ++y)
+			source->file.release(size_t(y) * source->rowBytes() + size_t(band.firstColumn) * source->sampleBytes(),
+				size_t(band.columns) * source->sampleBytes());
+		}
+
+	// Tiles at the finest depth resample the band bilinearly, weighted so
+	// a sample comes back exactly when t is 0 or 1. Their range is that of
+	// their samples, exact for the bilinear surface between them, and so
+	// are the ranges of their parts.
+	void buildFinest(glm::uvec2 const &cell, int worker)
+		{
+		auto cellsPerTile = int64_t(header.TileCells);
+		auto samples = block(cell, finest());
+		auto origin = glm::i64vec2(cell) * cellsPerTile;
+		if (sameGrid)
+			for (int j = 0; j < side(); ++j)
+				memcpy(samples + j * side(), band.row(int(origin.y) + j) + (origin.x - band.firstColumn), side() * sizeof(float));
+		else
+			{
+			// the columns are the same for every row
+			auto &columns = scratch[worker];
+			columns.lower.resize(size_t(side()));
+			columns.upper.resize(size_t(side()));
+			columns.weight.resize(size_t(side()));
+			for (int i = 0; i < side(); ++i)
+				{
+				auto x = sourceAt(origin.x + i, source->width);
+				columns.lower[i] = lowerSample(x, source->width) - band.firstColumn;
+				columns.upper[i] = upperSample(x, source->width) - band.firstColumn;
+				columns.weight[i] = float(x - lowerSample(x, source->width));
+				}
+
+			for (int j = 0; j < side(); ++j)
+				{
+				auto y = sourceAt(origin.y + j, source->height);
+				auto below = band.row(lowerSample(y, source->height)),
+					above = band.row(upperSample(y, source->height));
+				auto ty = float(y - lowerSample(y, source->height));
+				for (int i = 0; i < side(); ++i)
+					{
+					auto tx = columns.weight[i];
+					auto bottom = below[columns.lower[i]] * (1.f - tx) + below[columns.upper[i]] * tx,
+						top = above[columns.lower[i]] * (1.f - tx) + above[columns.upper[i]] * tx;
+					samples[j * side() + i] = bottom * (1.f - ty) + top * ty;
+					}
+				}
+			}
+
+		auto range = rangeBatch(samples, size_t(side()) * side());
+		entry(cell, finest()).Min = range.x;
+		entry(cell, finest()).Max = range.y;
+
+		// the smallest stored parts from the samples, each larger one from
+		// the four it's made of
+		auto levels = pyramidPartLevels(int(header.TileCells));
+		auto parts = reinterpret_cast<glm::vec2 *>(samples + size_t(side()) * side());
+		for (int level = levels; level >= 1; --level)
+			for (unsigned y = 0; y < 1u << level; ++y)
+				for (unsigned x = 0; x < 1u << level; ++x)
+					{
+					glm::vec2 part(0.f);
+					if (level == levels)
+						{
+						auto columns = pyramidPartSamples(x, level, int(header.TileCells)),
+							rows = pyramidPartSamples(y, level, int(header.TileCells));
+						for (auto row = rows.x; row <= rows.y; ++row)
+							{
+							auto span = rangeBatch(samples + size_t(row) * side() + columns.x, columns.y - columns.x + 1);
+							part = row == rows.x ? span : glm::vec2(std::min(part.x, span.x), std::max(part.y, span.y));
+							}
+						}
+					else
+						for (unsigned child = 0; child < 4; ++child)
+							{
+							auto &sub = parts[pyramidPartIndex(glm::uvec2(x, y) * 2u + glm::uvec2(child & 1, child >> 1), level + 1)];
+							part = child == 0 ? sub : glm::vec2(std::min(part.x, sub.x), std::max(part.y, sub.y));
+							}
+					parts[pyramidPartIndex(glm::uvec2(x, y), level)] = part;
+					}
+		}
+
+	// The four children's samples averaged down with a 1 2 1 tent each
+	// way, except along the tile's edges, which only average along the
+	// edge: the samples there are shared with the neighbouring tile, which
+	// has to come up with the same values without seeing these children.
+	// The range is the union of the children's, still over the full
+	// resolution surface.
+	void buildAveraged(glm::uvec2 const &cell, int depth, int worker)
+		{
+		auto const cellsPerTile = int(header.TileCells),
+			fine = 2 * cellsPerTile + 1;
+		float const *children[4];
+		auto lo = 0.f, hi = 0.f;
+		for (unsigned child = 0; child < 4; ++child)
+			{
+			auto childCell = cell * 2u + glm::uvec2(child & 1, child >> 1);
+			children[child] = block(childCell, depth + 1);
+			auto &childEntry = entry(childCell, depth + 1);
+			lo = child == 0 ? childEntry.Min : std::min(lo, childEntry.Min);
+			hi = child == 0 ? childEntry.Max : std::max(hi, childEntry.Max);
+			}
+
+		// three rows of the children side by side, their average down the
+		// columns and that averaged along the row
+		auto &buffer = scratch[worker].rows;
+		buffer.resize(size_t(fine) * 5);
+		float *rows[] = { buffer.data(), buffer.data() + fine, buffer.data() + 2 * fine };
+		auto columns = buffer.data() + 3 * fine,
+			along = buffer.data() + 4 * fine;
+		auto fineRow = [&](int j, float *out)
+			{
+			auto childY = std::min(j / cellsPerTile, 1);
+			auto local = size_t(j - childY * cellsPerTile) * side();
+			memcpy(out, children[childY * 2] + local, side() * sizeof(float));
+			memcpy(out + side(), children[childY * 2 + 1] + local + 1, cellsPerTile * sizeof(float));
+			};
+
+		auto samples = block(cell, depth);
+		for (int j = 0; j <= cellsPerTile; ++j)
+			{
+			if (j == 0 || j == cellsPerTile)
+				fineRow(2 * j, columns);
+			else
+				{
+				for (int k = 0; k < 3; ++k)
+					fineRow(2 * j - 1 + k, rows[k]);
+				tentBatch(rows[0], rows[1], rows[2], size_t(fine), columns);
+				}
+
+			tentBatch(columns, columns + 1, columns + 2, size_t(fine - 2), along);
+			auto out = samples + size_t(j) * side();
+			out[0] = columns[0];
+			for (int i = 1; i < cellsPerTile; ++i)
+				out[i] = along[2 * i - 1];
+			out[cellsPerTile] = columns[fine - 1];
+			}
+
+		entry(cell, depth).Min = lo;
+		entry(cell, depth).Max = hi;
+		}
+
+	// Tiles first.x to first.x + count - 1 of row first.y at depth
+	void buildRow(glm::uvec2 const &first, unsigned count, int depth)
+		{
+		for (unsigned x = 0; x < count; ++x)
+			{
+			glm::uvec2 cell(first.x + x, first.y);
+			if (depth == finest())
+				pool->push([this, cell](int worker) { buildFinest(cell, worker); });
+			else
+				pool->push([this, cell, depth](int worker) { buildAveraged(cell, depth, worker); });
+			}
+		pool->run();
+		}
+
+	void releaseRow(glm::uvec2 const &first, unsigned count, int depth) const
+		{
+		for (unsigned x = 0; x < count; ++x)
+			output.release(size_t(entry(glm::uvec2(first.x + x, first.y), depth).Offset), size_t(header.BlockBytes));
+		}
+
+	// Rows of the stripe under root, finest first; each odd row completes
+	// a pair, which is averaged into the row above and let go of, and so on
+	// up as long as that completes a pair too
+	void buildStripe(glm::uvec2 const &root, int rootDepth)
+		{
+		auto const across = 1u << (finest() - rootDepth);
+		for (unsigned row = 0; row < across; ++row)
+			{
+			auto first = root * across + glm::uvec2(0, row);
+			auto previousRows = glm::ivec2(band.firstRow, band.rows);
+			loadBand(first, across);
+			// rows the last band had that this one doesn't are done with,
+			// unless another stripe along still wants them
+			if (row > 0)
+				releaseRows(previousRows.x, band.firstRow - previousRows.x);
+			readAhead(band.firstRow + band.rows, band.rows);
+			buildRow(first, across, finest());
+
+			auto depth = finest();
+			for (auto done = row; depth > rootDepth && done & 1; done >>= 1, --depth)
+				{
+				auto count = 1u << (depth - rootDepth),
+					parentRow = root.y * (count / 2) + done / 2;
+				glm::uvec2 firstChild(root.x * count, parentRow * 2);
+				buildRow(glm::uvec2(root.x * (count / 2), parentRow), count / 2, depth - 1);
+				releaseRow(firstChild, count, depth);
+				releaseRow(firstChild + glm::uvec2(0, 1), count, depth);
+				}
+			}
+		releaseRows(band.firstRow, band.rows);
+		releaseRow(root, 1, rootDepth);
+		output.release(size_t(header.TableOffset), size_t(pyramidTileCount(int(header.Levels)) * sizeof(PyramidEntry)));
+		}
+
+	bool build(char const *path, int levels, int tileCells, TaskPool &tasks)
+		{
+		pool = &tasks;
+		scratch.resize(size_t(pool->size()));
+		header = makePyramidHeader(levels, tileCells);
+		sameGrid = source->width - 1 == int64_t(cells()) && source->height - 1 == int64_t(cells());
+		if (!output.create(path, size_t(header.FileBytes)))
+			return false;
+
+		memcpy(output.data(), &header, sizeof(header));
+		auto tiles = pyramidTileCount(levels);
+		auto firstBlock = header.FileBytes - tiles * header.BlockBytes;
+		for (uint64_t tile = 0; tile < tiles; ++tile)
+			table()[tile] = { firstBlock + tile * header.BlockBytes, 0.f, 0.f };
+
+		auto rootDepth = std::max(finest() - STRIPE_DEPTHS, 0);
+		for (unsigned y = 0; y < 1u << rootDepth; ++y)
+			for (unsigned x = 0; x < 1u << rootDepth; ++x)
+				buildStripe(glm::uvec2(x, y), rootDepth);
+
+		// the stripes' roots and up, a whole row at a time
+		for (int depth = rootDepth - 1; depth >= 0; --depth)
+			for (unsigned y = 0; y < 1u << depth; ++y)
+				{
+				buildRow(glm::uvec2(0, y), 1u << depth, depth);
+				releaseRow(glm::uvec2(0, 2 * y), 2u << depth, depth + 1);
+				releaseRow(glm::uvec2(0, 2 * y + 1), 2u << depth, depth + 1);
+				}
+
+		output.close();
+		return true;
+		}
+	};
+
+void usage()
+	{
+	fprintf(stderr,
+		"usage: OnxPyramidBuilder INPUT WIDTH HEIGHT OUTPUT [--float] [--scale S] [--offset O] [--tile-cells N] [--threads N]\n"
+		"  INPUT is a raw heightmap, 16 bit unsigned or with --float 32 bit float samples, little endian,\n"
+		"  rows from the root quad's minimum y; elevation = sample * S + O, S defaults to 1/65535\n");
+	}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 5)
+	{
+		usage();
+		return 1;
+	}
+
+	Heightmap heightmap;
+	heightmap.width = atoi(argv[2]);
+	heightmap.height = atoi(argv[3]);
+	char const *input = argv[1],
+		*output = argv[4];
+	int tileCells = DEFAULT_PYRAMID_TILE_CELLS,
+		threads = int(std::thread::hardware_concurrency());
+	bool scaleSet = false;
+
+	for (int i = 5; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--float") == 0)
+			heightmap.floats = true;
+		else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+		{
+			heightmap.scale = float(atof(argv[++i]));
+			scaleSet = true;
+		}
+		else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc)
+			heightmap.offset = float(atof(argv[++i]));
+		else if (strcmp(argv[i], "--tile-cells") == 0 && i + 1 < argc)
+			tileCells = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (heightmap.floats && !scaleSet)
+		heightmap.scale = 1.f;
+
+	// the averaging halves the samples, so tiles need an even number of cells
+	if (heightmap.width < 1 || heightmap.height < 1 || tileCells < 2 || tileCells % 2 || tileCells > 4096)
+	{
+		usage();
+		return 1;
+	}
+
+	if (!heightmap.file.openRead(input) || heightmap.file.size() < heightmap.rowBytes() * heightmap.height)
+	{
+		fprintf(stderr, "could not read %dx%d samples from %s\n", heightmap.width, heightmap.height, input);
+		return 1;
+	}
+
+	// enough depths that the finest has at least the heightmap's resolution
+	auto cells = std::max(heightmap.width, heightmap.height) - 1;
+	int levels = 1;
+	while (int64_t(tileCells) << (levels - 1) < cells && levels < MAX_PYRAMID_LEVELS)
+		++levels;
+
+	auto start = std::chrono::steady_clock::now();
+	TaskPool pool(threads);
+	PyramidBuilder builder;
+	builder.source = &heightmap;
+	if (!builder.build(output, levels, tileCells, pool))
+	{
+		fprintf(stderr, "could not write %s\n", output);
+		return 1;
+	}
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	auto header = makePyramidHeader(levels, tileCells);
+	auto inputMB = heightmap.rowBytes() * heightmap.height / (1024.0 * 1024.0);
+	printf("%s: %d levels of %dx%d cell tiles, %llu tiles, %.1f MB in %.2f s on %d threads (%s)\n",
+		output, levels, tileCells, tileCells, (unsigned long long)pyramidTileCount(levels),
+		header.FileBytes / (1024.0 * 1024.0), seconds, pool.size(), SAMPLE_ISA);
+	printf("read %.1f MB at %.1f MB/s\n", inputMB, inputMB / seconds);
+	return 0;
+}
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "BenchSupport.h"
+#include "OffscreenContext.h"
+#include "OrbitCamera.h"
+#include "TileGenerator.h"
+#include "TileRenderer.h"
+#include "TraceRecorder.h"
+
+// Headless render benchmark: the same camera paths as OnxCoreBench, with
+// every frame drawn by TileRenderer into an offscreen framebuffer. Reports
+// the CPU time spent submitting each frame, the GPU time from a
+// GL_TIME_ELAPSED query, and the tiles drawn. --suite checks scenario
+// scripts against a baseline as OnxCoreBench does, with the frame time
+// being generation plus submission.
+
+struct RenderFrame
+	{
+	int tiles;
+	int nodesVisited;
+	float generateMicroseconds;
+	float submitMicroseconds;
+	float gpuMicroseconds;
+	int allocations;
+	int64_t submitStart;	// TraceRecorder::now()
+	int traceFrame;
+	};
+
+struct RenderBench
+	{
+	OrbitCamera camera;
+	TileGenerator generator;
+	TileRenderer *renderer = nullptr;
+	std::vector<RenderFrame> frames;
+	std::vector<GLuint> queries;
+
+	// Unlike the window, which only redraws when the tiles change, every
+	// frame is drawn so every frame has a cost
+	void frame()
+		{
+		TraceRecorder::beginFrame();
+		TraceScope scope("frame", "frame");
+		auto allocations = AllocationCounter::allocations();
+		auto start = TraceRecorder::now();
+		auto moved = camera.update();
+		TraceRecorder::setFrameCamera(camera.traceCamera());
+		generator.update(camera.cameraState(), moved);
+		auto generated = TraceRecorder::now();
+
+		GLuint query;
+		glGenQueries(1, &query);
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		auto debugCamera = camera.buttonDown(ORBIT_LEFT_BUTTON) && camera.buttonDown(ORBIT_RIGHT_BUTTON);
+		renderer->render(generator.drawnTiles(), camera, debugCamera);
+		glEndQuery(GL_TIME_ELAPSED);
+		glFlush();
+		auto submitted = TraceRecorder::now();
+		auto frameAllocations = int(AllocationCounter::allocations() - allocations);
+		TraceRecorder::record("generate", "frame", start, generated);
+		TraceRecorder::record("submit", "frame", generated, submitted);
+
+		// Query results are collected at the end so reading them doesn't
+		// wait on the frame just submitted
+		queries.push_back(query);
+		RenderFrame result = {};
+		result.tiles = int(generator.drawnTiles().size());
+		result.nodesVisited = generator.traversalStats().nodesVisited;
+		result.generateMicroseconds = float(generated - start) * 0.001f;
+		result.submitMicroseconds = float(submitted - generated) * 0.001f;
+		result.allocations = frameAllocations;
+		result.submitStart = generated;
+		result.traceFrame = TraceRecorder::frame();
+		frames.push_back(result);
+		}
+
+	void collectQueries()
+		{
+		for (size_t i = 0; i < queries.size(); ++i)
+			{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+			frames[i].gpuMicroseconds = float(nanoseconds) * 0.001f;
+			TraceRecorder::recordGpu("draw", frames[i].submitStart, int64_t(nanoseconds), frames[i].traceFrame);
+			}
+		glDeleteQueries(GLsizei(queries.size()), queries.data());
+		queries.clear();
+		}
+	};
+
+void printLatency(char const *name, std::vector<float> values)
+	{
+	std::sort(values.begin(), values.end());
+	printf("%s us p50 %.1f p99 %.1f max %.1f\n", name, percentile(values, 0.5f), percentile(values, 0.99f), values.empty() ? 0.f : values.back());
+	}
+
+void printSummary(std::vector<RenderFrame> const &frames)
+	{
+	std::vector<float> generate, submit, gpu;
+	long long totalTiles = 0;
+	int maxTiles = 0;
+	AllocationSummary allocations;
+	for (auto &frame : frames)
+		{
+		allocations.add(frame.allocations);
+		generate.push_back(frame.generateMicroseconds);
+		submit.push_back(frame.submitMicroseconds);
+		gpu.push_back(frame.gpuMicroseconds);
+		totalTiles += frame.tiles;
+		maxTiles = std::max(maxTiles, frame.tiles);
+		}
+
+	printf("frames %zu\n", frames.size());
+	printf("tiles avg %lld max %d\n", frames.empty() ? 0 : totalTiles / (long long)frames.size(), maxTiles);
+	printLatency("generate", generate);
+	printLatency("submit", submit);
+	printLatency("gpu", gpu);
+	allocations.print();
+	}
+
+// One pass over a scenario script with a fresh camera and generator, for
+// runSuite
+bool runScenario(std::string const &script, GeneratorOptions const &options, TileRenderer &renderer, ScenarioResult &result)
+	{
+	RenderBench bench;
+	bench.renderer = &renderer;
+	options.apply(bench.generator);
+	if (!runCameraScript(bench.camera, script.c_str(), [&bench]() { bench.frame(); }) || bench.frames.empty())
+		return false;
+	glFinish();
+	bench.collectQueries();
+
+	double nodes = 0, tiles = 0, generateMicroseconds = 0;
+	std::vector<float> latency;
+	for (auto &frame : bench.frames)
+		{
+		nodes += frame.nodesVisited;
+		tiles += frame.tiles;
+		generateMicroseconds += frame.generateMicroseconds;
+		latency.push_back(frame.generateMicroseconds + frame.submitMicroseconds);
+		}
+	std::sort(latency.begin(), latency.end());
+
+	result.nodesPerSecond = nodes / std::max(generateMicroseconds, 1.0) * 1e6;
+	result.nodesPerFrame = nodes / bench.frames.size();
+	result.tilesPerFrame = tiles / bench.frames.size();
+	result.p99Microseconds = percentile(latency, 0.99f);
+	return true;
+	}
+
+void usage()
+	{
+	fprintf(stderr,
+		"usage: OnxCoreRenderBench [--path orbit|zoom|sweep | --script FILE | --replay FILE] [--frames N] [--per-frame] [--trace FILE]\n"
+		"  [--render instanced|delta|immediate] [--core-profile] [--resources DIR]\n"
+		"       OnxCoreRenderBench %s\n%s",
+		SUITE_USAGE, GENERATOR_USAGE);
+	}
+
+int main(int argc, char* argv[])
+{
+	RenderBench bench;
+	GeneratorOptions options;
+	SuiteOptions suite;
+	// submission on a software GL swings the p99 twice as far as the
+	// traversal alone, up to +99% over four suite runs of one build
+	suite.p99Tolerance = 200;
+	std::string path = "orbit",
+		renderMode = "instanced",
+		resources = "OnxCoreTest/Resources/";
+	char const *script = nullptr,
+		*replay = nullptr,
+		*trace = nullptr;
+	int frames = 600;
+	bool perFrame = false,
+		coreProfile = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+			path = argv[++i];
+		else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+			script = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replay = argv[++i];
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc)
+			renderMode = argv[++i];
+		else if (strcmp(argv[i], "--core-profile") == 0)
+			coreProfile = true;
+		else if (strcmp(argv[i], "--resources") == 0 && i + 1 < argc)
+			resources = std::string(argv[++i]) + "/";
+		else if (strcmp(argv[i], "--per-frame") == 0)
+			perFrame = true;
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			trace = argv[++i];
+		else if (!suite.parse(argc, argv, i) && !options.parse(argc, argv, i))
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (!options.validate())
+		return 1;
+	options.apply(bench.generator);
+
+	OffscreenContext context;
+	if (!context.create(WINDOW_WIDTH, WINDOW_HEIGHT, coreProfile))
+		return 1;
+	printf("renderer %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	TileRenderer renderer(resources);
+	renderer.setHeightfield(options.drawnHeightfield());
+	bench.renderer = &renderer;
+	if (renderMode == "delta")
+		renderer.setRenderMode(RenderMode::DeltaInstanced);
+	else if (renderMode == "immediate")
+		renderer.setRenderMode(RenderMode::Immediate);
+	else if (renderMode != "instanced")
+	{
+		usage();
+		return 1;
+	}
+
+	if (!suite.directory.empty())
+	{
+		if (options.threads == 0)
+			options.threads = 1;
+		return runSuite(suite, "render-baseline.txt", [&options, &renderer](std::string const &script, ScenarioResult &result)
+			{
+			return runScenario(script, options, renderer, result);
+			}, argc, argv);
+	}
+
+	// One frame off the record: the first one allocates the tile buffers
+	// and llvmpipe's first GL_TIME_ELAPSED result is garbage
+	bench.frame();
+	glFinish();
+	glDeleteQueries(GLsizei(bench.queries.size()), bench.queries.data());
+	bench.queries.clear();
+	bench.frames.clear();
+
+	if (trace)
+	{
+		TraceRecorder::setThreadName("main");
+		TraceRecorder::start();
+	}
+
+	auto frame = [&bench]() { bench.frame(); };
+	if (script)
+	{
+		if (!runCameraScript(bench.camera, script, frame))
+			return 1;
+	}
+	else if (replay)
+	{
+		if (!runInputReplay(bench.camera, replay, frame))
+			return 1;
+	}
+	else if (!runCameraPath(bench.camera, path, frames, frame))
+	{
+		usage();
+		return 1;
+	}
+
+	glFinish();
+	bench.collectQueries();
+
+	if (perFrame)
+	{
+		printf("frame,tiles,generateUs,submitUs,gpuUs,allocations\n");
+		for (size_t i = 0; i < bench.frames.size(); ++i)
+		{
+			auto &frame = bench.frames[i];
+			printf("%zu,%d,%.1f,%.1f,%.1f,%d\n", i, frame.tiles, frame.generateMicroseconds, frame.submitMicroseconds, frame.gpuMicroseconds, frame.allocations);
+		}
+	}
+	printSummary(bench.frames);
+	if (trace && !TraceRecorder::write(trace))
+	{
+		fprintf(stderr, "could not write %s\n", trace);
+		return 1;
+	}
+
+	auto error = glGetError();
+	if (error != GL_NO_ERROR)
+	{
+		fprintf(stderr, "GL error 0x%x\n", error);
+		return 1;
+	}
+	return 0;
+}
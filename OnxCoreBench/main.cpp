@@ -0,0 +1,678 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtc/noise.hpp>
+
+#include "AllocationCounter.h"
+#include "BenchSupport.h"
+#include "NoiseBatch.h"
+#include "OrbitCamera.h"
+#include "TileGenerator.h"
+#include "TraceRecorder.h"
+
+// Headless driver for the LOD core: moves an OrbitCamera along a built in
+// path or a script (see BenchSupport.h), feeds every frame to a
+// TileGenerator the way OpenglWindow::Render does and reports what each
+// frame cost. --suite checks a directory of scenario scripts against a
+// baseline, see runSuite. --noise measures the batched noise against glm's
+// scalar noise instead, --range-check the terrain's elevation ranges
+// against its surface, --clip-check the clip space corners the recursive
+// traversal averages against projecting them, see ClipCheck, and
+// --work-report the persistent quadtree against a rebuild, see WorkReport.
+// --pace sleeps between frames, which gives a tile loader's I/O threads the
+// time a real frame would.
+
+struct FrameResult
+	{
+	int tiles;
+	int nodesVisited;
+	int maxDepth;
+	float microseconds;
+	int allocations;
+	int deferred;
+	};
+
+struct Bench
+	{
+	OrbitCamera camera;
+	TileGenerator generator;
+	std::vector<FrameResult> frames;
+	bool perFrame = false;
+	int pace = 0;	// microseconds slept after each frame, outside its timing
+
+	void frame()
+		{
+		TraceRecorder::beginFrame();
+		TraceScope scope("frame", "frame");
+		auto allocations = AllocationCounter::allocations();
+		auto start = std::chrono::steady_clock::now();
+		auto moved = camera.update();
+		TraceRecorder::setFrameCamera(camera.traceCamera());
+		generator.update(camera.cameraState(), moved);
+		auto elapsed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+		auto &stats = generator.traversalStats();
+		FrameResult result = { stats.tiles, stats.nodesVisited, stats.maxDepth, elapsed, int(AllocationCounter::allocations() - allocations), stats.deferred };
+		if (perFrame)
+			printf("%zu,%d,%d,%d,%.1f,%d,%d\n", frames.size(), result.tiles, result.nodesVisited, result.maxDepth, result.microseconds, result.allocations, result.deferred);
+		frames.push_back(result);
+		if (pace > 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(pace));
+		}
+	};
+
+void printSummary(std::vector<FrameResult> const &frames)
+	{
+	std::vector<float> latency;
+	int maxTiles = 0, maxNodes = 0, maxDepth = 0,
+		deferredFrames = 0, lastDeferred = -1;
+	long long totalTiles = 0;
+	AllocationSummary allocations;
+	for (auto &frame : frames)
+		{
+		allocations.add(frame.allocations);
+		latency.push_back(frame.microseconds);
+		maxTiles = std::max(maxTiles, frame.tiles);
+		maxNodes = std::max(maxNodes, frame.nodesVisited);
+		maxDepth = std::max(maxDepth, frame.maxDepth);
+		totalTiles += frame.tiles;
+		if (frame.deferred > 0)
+			{
+			++deferredFrames;
+			lastDeferred = int(&frame - frames.data());
+			}
+		}
+	std::sort(latency.begin(), latency.end());
+
+	printf("frames %zu\n", frames.size());
+	printf("tiles avg %lld max %d\n", frames.empty() ? 0 : totalTiles / (long long)frames.size(), maxTiles);
+	printf("nodes visited max %d\n", maxNodes);
+	printf("max depth %d\n", maxDepth);
+	printf("frames with deferred nodes %d, last %d\n", deferredFrames, lastDeferred);
+	allocations.print();
+	printf("frame us p50 %.1f p99 %.1f max %.1f\n", percentile(latency, 0.5f), percentile(latency, 0.99f), latency.empty() ? 0.f : latency.back());
+	}
+
+// One pass over a scenario script on a fresh generator, for runSuite
+bool runScenario(std::string const &script, GeneratorOptions const &options, ScenarioResult &result)
+	{
+	Bench bench;
+	options.apply(bench.generator);
+	if (!runCameraScript(bench.camera, script.c_str(), [&bench]() { bench.frame(); }) || bench.frames.empty())
+		return false;
+
+	double nodes = 0, tiles = 0, microseconds = 0;
+	std::vector<float> latency;
+	for (auto &frame : bench.frames)
+		{
+		nodes += frame.nodesVisited;
+		tiles += frame.tiles;
+		microseconds += frame.microseconds;
+		latency.push_back(frame.microseconds);
+		}
+	std::sort(latency.begin(), latency.end());
+
+	result.nodesPerSecond = nodes / std::max(microseconds, 1.0) * 1e6;
+	result.nodesPerFrame = nodes / bench.frames.size();
+	result.tilesPerFrame = tiles / bench.frames.size();
+	result.p99Microseconds = percentile(latency, 0.99f);
+	return true;
+	}
+
+// Distance between two floats in units in the last place
+int64_t ulpDistance(float a, float b)
+	{
+	int32_t ia, ib;
+	memcpy(&ia, &a, sizeof(ia));
+	memcpy(&ib, &b, sizeof(ib));
+	// flip negatives so the integers are ordered like the floats
+	auto ordered = [](int32_t i) { return i < 0 ? int64_t(INT32_MIN) - i : int64_t(i); };
+	auto distance = ordered(ia) - ordered(ib);
+	return distance < 0 ? -distance : distance;
+	}
+
+// Best of a few passes, in samples per second
+template <class Pass>
+double samplesPerSecond(size_t samples, Pass const &pass)
+	{
+	double best = 0;
+	for (int run = 0; run < 5; ++run)
+		{
+		auto start = std::chrono::steady_clock::now();
+		pass();
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		best = std::max(best, samples / std::max(seconds, 1e-9));
+		}
+	return best;
+	}
+
+// Scalar glm against the batch version of each noise over the same random
+// points: throughput and the largest difference between the two
+void runNoiseBench(size_t samples)
+	{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+	std::vector<float> x(samples), y(samples), z(samples), scalar(samples), batch(samples);
+	for (size_t i = 0; i < samples; ++i)
+		{
+		x[i] = coordinate(random);
+		y[i] = coordinate(random);
+		z[i] = coordinate(random);
+		}
+
+	// the terrain's own settings, see ProceduralTerrain
+	FractalNoise terrain;
+	terrain.Amplitude = 0.6f;
+	terrain.Frequency = 0.3f;
+	terrain.Octaves = 6;
+	terrain.Offset = glm::vec2(17.f, 5.f);
+
+	printf("noise %s, %d lanes, %zu samples\n", NOISE_ISA, NOISE_LANES, samples);
+	auto report = [&](char const *name, double scalarRate, double batchRate)
+		{
+		int64_t maxUlps = 0;
+		float maxError = 0;
+		for (size_t i = 0; i < samples; ++i)
+			{
+			maxUlps = std::max(maxUlps, ulpDistance(scalar[i], batch[i]));
+			maxError = std::max(maxError, std::abs(scalar[i] - batch[i]));
+			}
+		printf("%-9s scalar %7.2f Msamples/s  batch %7.2f Msamples/s  x%.2f  max diff %lld ulps (%g)\n",
+			name, scalarRate * 1e-6, batchRate * 1e-6, batchRate / scalarRate, (long long)maxUlps, maxError);
+		};
+
+	report("simplex2",
+		samplesPerSecond(samples, [&]() { for (size_t i = 0; i < samples; ++i) scalar[i] = glm::simplex(glm::vec2(x[i], y[i])); }),
+		samplesPerSecond(samples, [&]() { simplexBatch(x.data(), y.data(), samples, batch.data()); }));
+	report("simplex3",
+		samplesPerSecond(samples, [&]() { for (size_t i = 0; i < samples; ++i) scalar[i] = glm::simplex(glm::vec3(x[i], y[i], z[i])); }),
+		samplesPerSecond(samples, [&]() { simplexBatch(x.data(), y.data(), z.data(), samples, batch.data()); }));
+	report("fbm x6",
+		samplesPerSecond(samples, [&]() { for (size_t i = 0; i < samples; ++i) scalar[i] = fractalNoise(glm::vec2(x[i], y[i]), terrain); }),
+		samplesPerSecond(samples, [&]() { fractalBatch(x.data(), y.data(), samples, terrain, batch.data()); }));
+	}
+
+// The terrain's elevation ranges (Heightfield::range) against its surface,
+// on random tiles at every depth with a fixed seed: each range has to hold
+// the bilinear surface sampled on a grid over the tile, to within the
+// rounding of the interpolation, and down to the grid's own depth has to be
+// exactly the min/max of the samples the tile covers
+int runRangeCheck(size_t tiles)
+	{
+	constexpr int GRID = 8;
+	auto heightfield = terrainHeightfield();
+	auto const levels = heightfield->levels();
+	auto const side = size_t(heightfield->samplesPerSide());
+	auto const &samples = heightfield->samples();
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> depths(0, MAX_SUBDIVISION_DEPTH);
+	size_t notContaining = 0, exactTiles = 0, notExact = 0;
+	for (size_t tile = 0; tile < tiles; ++tile)
+		{
+		auto depth = depths(random);
+		std::uniform_int_distribution<unsigned> cells(0, (1u << depth) - 1);
+		glm::uvec2 cell(cells(random), cells(random));
+		auto range = heightfield->range(cell, depth);
+
+		// grid points inside the tile, so rounding can't put one in the
+		// neighbouring cell
+		auto size = 2.f * ROOT_HALF_SIZE / float(1u << depth);
+		auto p1 = glm::vec2(cell) * size - ROOT_HALF_SIZE;
+		auto slack = 4 * FLT_EPSILON * std::max(std::abs(range.x), std::abs(range.y));
+		bool contained = true;
+		for (int j = 0; j < GRID; ++j)
+			for (int i = 0; i < GRID; ++i)
+				{
+				auto height = heightfield->height(p1 + size * (glm::vec2(i, j) + 0.5f) / float(GRID));
+				contained = contained && height >= range.x - slack && height <= range.y + slack;
+				}
+		notContaining += !contained;
+
+		if (depth > levels)
+			continue;
+		auto span = size_t(1) << (levels - depth);
+		glm::vec2 expected(HUGE_VALF, -HUGE_VALF);
+		for (auto y = cell.y * span; y <= (cell.y + 1) * span; ++y)
+			for (auto x = cell.x * span; x <= (cell.x + 1) * span; ++x)
+				{
+				auto sample = samples[y * side + x];
+				expected = glm::vec2(std::min(expected.x, sample), std::max(expected.y, sample));
+				}
+		++exactTiles;
+		notExact += expected != range;
+		}
+
+	printf("ranges of %zu tiles, depth 0-%d, grid depth %d\n", tiles, MAX_SUBDIVISION_DEPTH, levels);
+	printf("%zu don't hold the surface, %zu of %zu at or above grid depth aren't their samples' min/max\n", notContaining, notExact, exactTiles);
+	return notContaining + notExact > 0 ? 1 : 0;
+	}
+
+// How close generateTiles' decisions about the node come to going the
+// other way, redone in doubles from its world space corners, in multiples
+// of the most that float rounding can have moved its clip space corners:
+// error per coordinate, depth + 1 roundings of the root's corners, whose
+// largest coordinate is rootMagnitude. Averaged corners are within it of
+// the projected ones, so a node with a margin over 1 can't go different
+// ways. The tests are w against 0, the corners against each side of the
+// clip space cube, and each edge's length against the detail level.
+double decisionMargin(glm::dmat4 const &viewProj, double detail, double rootMagnitude, uint64_t key)
+	{
+	auto size = 2.0 * ROOT_HALF_SIZE / double(1u << tileKeyDepth(key));
+	auto p1 = glm::dvec2(tileKeyCell(key)) * size - double(ROOT_HALF_SIZE);
+	glm::dvec2 const corners[] = { p1, p1 + glm::dvec2(size, 0), p1 + size, p1 + glm::dvec2(0, size) };
+	auto error = (tileKeyDepth(key) + 1) * double(FLT_EPSILON) * rootMagnitude;
+
+	auto margin = HUGE_VAL;
+	glm::dvec4 clip[4];
+	glm::dvec2 screen[4];
+	double drift[4];	// how far the error can move the corner on screen
+	for (int i = 0; i < 4; ++i)
+		{
+		clip[i] = viewProj * glm::dvec4(corners[i], 0, 1);
+		auto w = std::abs(clip[i].w);
+		margin = std::min(margin, w / error);
+		screen[i] = glm::dvec2(clip[i]) / w;
+		drift[i] = error * (1 + glm::length(screen[i])) * std::sqrt(2.0) / w;
+		}
+
+	// a side culls when every corner is past it: passing, the corner nearest
+	// to it decides; failing, the furthest of those that aren't past it
+	auto side = [&](double (*past)(glm::dvec4 const &))
+		{
+		bool all = true;
+		auto nearest = HUGE_VAL, furthest = 0.0;
+		for (auto const &corner : clip)
+			{
+			auto distance = past(corner) / (2 * error);
+			if (distance >= 0)
+				nearest = std::min(nearest, distance);
+			else
+				{
+				all = false;
+				furthest = std::max(furthest, -distance);
+				}
+			}
+		margin = std::min(margin, all ? nearest : furthest);
+		};
+	side([](glm::dvec4 const &c) { return c.x - std::abs(c.w); });
+	side([](glm::dvec4 const &c) { return -c.x - std::abs(c.w); });
+	side([](glm::dvec4 const &c) { return c.y - std::abs(c.w); });
+	side([](glm::dvec4 const &c) { return -c.y - std::abs(c.w); });
+	side([](glm::dvec4 const &c) { return c.z - std::abs(c.w); });
+
+	for (int i = 0; i < 4; ++i)
+		{
+		auto next = (i + 1) & 3;
+		margin = std::min(margin, std::abs(glm::length(screen[i] - screen[next]) - detail) / (drift[i] + drift[next]));
+		}
+	return margin;
+	}
+
+// The recursive traversal with corners averaged down the tree against the
+// same with every node's projected (TileGenerator::setProjectedCorners), on
+// the same cameras: their frame times, and every tile one has and the other
+// doesn't. Those are allowed only where the tile's or its parent's
+// decisionMargin is 1 or less, rounding could have tipped them either way;
+// any other difference fails the check.
+struct ClipCheck
+	{
+	OrbitCamera *camera = nullptr;
+	TileGenerator averaged,
+		projected;
+	std::vector<float> averagedTimes,
+		projectedTimes;
+	std::vector<uint64_t> averagedKeys,
+		projectedKeys,
+		differing;
+	long long averagedTiles = 0,
+		projectedTiles = 0,
+		differingTiles = 0,
+		unexplained = 0;
+	int differingFrames = 0;
+	double worstMargin = 0;
+
+	void setup(OrbitCamera &orbit, GeneratorOptions const &options)
+		{
+		camera = &orbit;
+		options.apply(averaged);
+		options.apply(projected);
+		projected.setProjectedCorners(true);
+		}
+
+	static void build(TileGenerator &generator, CameraState const &state, bool moved, std::vector<float> &times, std::vector<uint64_t> &keys)
+		{
+		auto start = std::chrono::steady_clock::now();
+		generator.update(state, moved);
+		times.push_back(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+		keys.clear();
+		for (auto &tile : generator.drawnTiles())
+			keys.push_back(tile.Key);
+		std::sort(keys.begin(), keys.end());
+		}
+
+	void frame()
+		{
+		auto moved = camera->update();
+		auto state = camera->cameraState();
+		build(averaged, state, moved, averagedTimes, averagedKeys);
+		build(projected, state, moved, projectedTimes, projectedKeys);
+		averagedTiles += averagedKeys.size();
+		projectedTiles += projectedKeys.size();
+
+		differing.clear();
+		std::set_symmetric_difference(averagedKeys.begin(), averagedKeys.end(), projectedKeys.begin(), projectedKeys.end(), std::back_inserter(differing));
+		if (differing.empty())
+			return;
+
+		++differingFrames;
+		differingTiles += differing.size();
+		glm::dmat4 const viewProj(state.ViewProj);
+		auto rootMagnitude = 0.0;
+		for (int i = 0; i < 4; ++i)
+			{
+			auto corner = glm::abs(viewProj * glm::dvec4(i == 1 || i == 2 ? -ROOT_HALF_SIZE : ROOT_HALF_SIZE, i < 2 ? ROOT_HALF_SIZE : -ROOT_HALF_SIZE, 0, 1));
+			rootMagnitude = std::max(rootMagnitude, std::max(std::max(corner.x, corner.y), std::max(corner.z, corner.w)));
+			}
+		for (auto key : differing)
+			{
+			auto margin = decisionMargin(viewProj, state.Detail, rootMagnitude, key);
+			if (tileKeyDepth(key) > 0)
+				margin = std::min(margin, decisionMargin(viewProj, state.Detail, rootMagnitude, makeTileKey(tileKeyCell(key) / 2u, tileKeyDepth(key) - 1)));
+			worstMargin = std::max(worstMargin, margin);
+			unexplained += margin > 1;
+			}
+		}
+
+	int report()
+		{
+		std::sort(averagedTimes.begin(), averagedTimes.end());
+		std::sort(projectedTimes.begin(), projectedTimes.end());
+		auto averagedP50 = percentile(averagedTimes, 0.5f),
+			projectedP50 = percentile(projectedTimes, 0.5f);
+		printf("frames %zu\n", averagedTimes.size());
+		printf("averaged corners us p50 %.1f p99 %.1f, projected p50 %.1f p99 %.1f, x%.2f\n",
+			averagedP50, percentile(averagedTimes, 0.99f), projectedP50, percentile(projectedTimes, 0.99f), projectedP50 / std::max(averagedP50, 1e-3f));
+		printf("tiles %lld averaged, %lld projected, %lld in one only over %d frames, largest margin %.2g, %lld past rounding\n",
+			averagedTiles, projectedTiles, differingTiles, differingFrames, worstMargin, unexplained);
+		return unexplained > 0 ? 1 : 0;
+		}
+	};
+
+// Frame to frame work of the persistent quadtree (TraversalMode::Incremental)
+// against rebuilding the tree every frame, on the same cameras: nodes
+// evaluated, splits and merges, frame times, and every tile one has and the
+// other doesn't. The two make the same decisions; tiles differ only where
+// the persistent tree hasn't yet rechecked a node whose result has changed.
+struct WorkReport
+	{
+	struct Frame
+		{
+		int rebuildNodes,
+			incrementalNodes,
+			splits,
+			merges,
+			tiles,
+			differing;
+		float rebuildMicroseconds,
+			incrementalMicroseconds;
+		};
+
+	OrbitCamera *camera = nullptr;
+	TileGenerator rebuild,
+		incremental;
+	std::vector<Frame> frames;
+	std::vector<uint64_t> rebuildKeys,
+		incrementalKeys,
+		differing;
+	bool perFrame = false;
+
+	void setup(OrbitCamera &orbit, GeneratorOptions options)
+		{
+		camera = &orbit;
+		options.apply(incremental);
+		if (options.mode == TraversalMode::Incremental)
+			options.mode = TraversalMode::Recursive;
+		options.apply(rebuild);
+		incremental.setTraversalMode(TraversalMode::Incremental);
+		}
+
+	static float build(TileGenerator &generator, CameraState const &state, bool moved, std::vector<uint64_t> &keys)
+		{
+		auto start = std::chrono::steady_clock::now();
+		generator.update(state, moved);
+		auto elapsed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+		keys.clear();
+		for (auto &tile : generator.drawnTiles())
+			keys.push_back(tile.Key);
+		std::sort(keys.begin(), keys.end());
+		return elapsed;
+		}
+
+	void frame()
+		{
+		auto moved = camera->update();
+		auto state = camera->cameraState();
+		Frame result = {};
+		result.rebuildMicroseconds = build(rebuild, state, moved, rebuildKeys);
+		result.incrementalMicroseconds = build(incremental, state, moved, incrementalKeys);
+
+		differing.clear();
+		std::set_symmetric_difference(rebuildKeys.begin(), rebuildKeys.end(), incrementalKeys.begin(), incrementalKeys.end(), std::back_inserter(differing));
+		auto &stats = incremental.traversalStats();
+		result.rebuildNodes = rebuild.traversalStats().nodesVisited;
+		result.incrementalNodes = stats.nodesVisited;
+		result.splits = stats.splits;
+		result.merges = stats.merges;
+		result.tiles = int(rebuildKeys.size());
+		result.differing = int(differing.size());
+		if (perFrame)
+			printf("%zu,%d,%.1f,%d,%.1f,%d,%d,%d,%d\n", frames.size(), result.rebuildNodes, result.rebuildMicroseconds, result.incrementalNodes,
+				result.incrementalMicroseconds, result.splits, result.merges, result.tiles, result.differing);
+		frames.push_back(result);
+		}
+
+	void report() const
+		{
+		double rebuildNodes = 0, incrementalNodes = 0, splits = 0, merges = 0, tiles = 0, differingTiles = 0;
+		int cheaper = 0, differingFrames = 0, maxDiffering = 0;
+		std::vector<float> rebuildTimes, incrementalTimes;
+		for (auto &frame : frames)
+			{
+			rebuildNodes += frame.rebuildNodes;
+			incrementalNodes += frame.incrementalNodes;
+			splits += frame.splits;
+			merges += frame.merges;
+			tiles += frame.tiles;
+			differingTiles += frame.differing;
+			differingFrames += frame.differing > 0;
+			maxDiffering = std::max(maxDiffering, frame.differing);
+			cheaper += frame.incrementalMicroseconds < frame.rebuildMicroseconds;
+			rebuildTimes.push_back(frame.rebuildMicroseconds);
+			incrementalTimes.push_back(frame.incrementalMicroseconds);
+			}
+		std::sort(rebuildTimes.begin(), rebuildTimes.end());
+		std::sort(incrementalTimes.begin(), incrementalTimes.end());
+
+		auto count = double(std::max<size_t>(frames.size(), 1));
+		printf("frames %zu, tiles avg %.1f\n", frames.size(), tiles / count);
+		printf("rebuild     nodes/frame %7.1f                          us p50 %.1f p99 %.1f\n",
+			rebuildNodes / count, percentile(rebuildTimes, 0.5f), percentile(rebuildTimes, 0.99f));
+		printf("incremental nodes/frame %7.1f splits %5.2f merges %5.2f us p50 %.1f p99 %.1f\n",
+			incrementalNodes / count, splits / count, merges / count, percentile(incrementalTimes, 0.5f), percentile(incrementalTimes, 0.99f));
+		printf("incremental cheaper on %d frames, tiles in one only avg %.2f max %d over %d frames\n",
+			cheaper, differingTiles / count, maxDiffering, differingFrames);
+		}
+	};
+
+void usage()
+	{
+	fprintf(stderr,
+		"usage: OnxCoreBench [--path orbit|zoom|sweep | --script FILE | --replay FILE] [--frames N] [--per-frame] [--trace FILE] [--pace US]\n"
+		"       OnxCoreBench %s\n"
+		"       OnxCoreBench --noise [--samples N]\n"
+		"       OnxCoreBench --range-check [--samples N]\n"
+		"       OnxCoreBench --clip-check [--path P | --script FILE | --replay FILE] [--frames N]\n"
+		"       OnxCoreBench --work-report [--path P | --script FILE | --replay FILE] [--frames N] [--per-frame]\n%s",
+		SUITE_USAGE, GENERATOR_USAGE);
+	}
+
+int main(int argc, char* argv[])
+{
+	Bench bench;
+	std::string path = "orbit";
+	char const *script = nullptr,
+		*replay = nullptr,
+		*trace = nullptr;
+	int frames = 600;
+	size_t samples = 0;	// the harness's own default
+	bool noise = false,
+		rangeCheck = false,
+		clipCheck = false,
+		workReport = false;
+	GeneratorOptions options;
+	SuiteOptions suite;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+			path = argv[++i];
+		else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+			script = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replay = argv[++i];
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--per-frame") == 0)
+			bench.perFrame = true;
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			trace = argv[++i];
+		else if (strcmp(argv[i], "--pace") == 0 && i + 1 < argc)
+			bench.pace = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--noise") == 0)
+			noise = true;
+		else if (strcmp(argv[i], "--range-check") == 0)
+			rangeCheck = true;
+		else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+			samples = size_t(std::max(atoi(argv[++i]), 1));
+		else if (strcmp(argv[i], "--clip-check") == 0)
+			clipCheck = true;
+		else if (strcmp(argv[i], "--work-report") == 0)
+			workReport = true;
+		else if (!suite.parse(argc, argv, i) && !options.parse(argc, argv, i))
+		{
+			usage();
+			return 1;
+		}
+	}
+	if (!options.validate())
+		return 1;
+	if (noise)
+	{
+		runNoiseBench(samples ? samples : size_t(1) << 20);
+		return 0;
+	}
+	if (rangeCheck)
+		return runRangeCheck(samples ? samples : 20000);
+	if (!suite.directory.empty())
+	{
+		// One thread unless told otherwise, so the baseline doesn't depend
+		// on the core count
+		if (options.threads == 0)
+			options.threads = 1;
+		return runSuite(suite, "baseline.txt", [&options](std::string const &script, ScenarioResult &result)
+			{
+			return runScenario(script, options, result);
+			}, argc, argv);
+	}
+	ClipCheck check;
+	if (clipCheck)
+	{
+		if (options.mode != TraversalMode::Recursive || options.terrain || options.pyramid)
+		{
+			fprintf(stderr, "--clip-check compares the recursive traversal over the flat quad\n");
+			return 1;
+		}
+		// one thread unless told otherwise, as for the suite
+		if (options.threads == 0)
+			options.threads = 1;
+		check.setup(bench.camera, options);
+	}
+	WorkReport work;
+	if (workReport)
+	{
+		if (options.terrain || options.pyramid)
+		{
+			fprintf(stderr, "--work-report compares the persistent tree over the flat quad\n");
+			return 1;
+		}
+		if (options.threads == 0)
+			options.threads = 1;
+		work.perFrame = bench.perFrame;
+		work.setup(bench.camera, options);
+	}
+	if (!clipCheck && !workReport)
+		options.apply(bench.generator);
+
+	if (trace)
+	{
+		TraceRecorder::setThreadName("main");
+		TraceRecorder::start();
+	}
+	if (workReport && bench.perFrame)
+		printf("frame,rebuildNodes,rebuildUs,incrementalNodes,incrementalUs,splits,merges,tiles,differing\n");
+	else if (bench.perFrame)
+		printf("frame,tiles,nodes,maxDepth,us,allocations,deferred\n");
+
+	FrameFunction frame = [&bench]() { bench.frame(); };
+	if (clipCheck)
+		frame = [&check]() { check.frame(); };
+	else if (workReport)
+		frame = [&work]() { work.frame(); };
+	if (script)
+	{
+		if (!runCameraScript(bench.camera, script, frame))
+			return 1;
+	}
+	else if (replay)
+	{
+		if (!runInputReplay(bench.camera, replay, frame))
+			return 1;
+	}
+	else if (!runCameraPath(bench.camera, path, frames, frame))
+	{
+		usage();
+		return 1;
+	}
+
+	if (clipCheck)
+		return check.report();
+	if (workReport)
+	{
+		work.report();
+		return 0;
+	}
+
+	printSummary(bench.frames);
+	if (auto &loader = bench.generator.tileLoader())
+	{
+		auto stats = loader->stats();
+		printf("loader loaded %lld cancelled %lld evicted %lld failed %lld, %d resident %.1f MB, %d queued %d loading\n",
+			stats.loaded, stats.cancelled, stats.evicted, stats.failed, stats.resident, stats.residentBytes / (1024.0 * 1024.0), stats.queued, stats.loading);
+	}
+	if (trace && !TraceRecorder::write(trace))
+	{
+		fprintf(stderr, "could not write %s\n", trace);
+		return 1;
+	}
+	return 0;
+}
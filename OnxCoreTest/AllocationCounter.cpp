@@ -0,0 +1,94 @@
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+std::atomic<uint64_t> AllocationCounter::_allocations { 0 },
+	AllocationCounter::_bytes { 0 };
+
+// The replacements every other form of operator new and delete forward to
+namespace
+	{
+	void *allocate(size_t size)
+		{
+		AllocationCounter::record(size);
+		return std::malloc(size ? size : 1);
+		}
+
+	void *allocateAligned(size_t size, std::align_val_t alignment)
+		{
+		AllocationCounter::record(size);
+		auto align = size_t(alignment);
+#ifdef _WIN32
+		return _aligned_malloc(size ? size : 1, align);
+#else
+		// aligned_alloc wants the size to be a multiple of the alignment
+		return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+		}
+
+	void freeAligned(void *block)
+		{
+#ifdef _WIN32
+		_aligned_free(block);
+#else
+		std::free(block);
+#endif
+		}
+	}
+
+void *operator new(size_t size)
+	{
+	if (auto block = allocate(size))
+		return block;
+	throw std::bad_alloc();
+	}
+
+void *operator new[](size_t size)
+	{
+	return operator new(size);
+	}
+
+void *operator new(size_t size, std::nothrow_t const &) noexcept
+	{
+	return allocate(size);
+	}
+
+void *operator new[](size_t size, std::nothrow_t const &) noexcept
+	{
+	return allocate(size);
+	}
+
+void *operator new(size_t size, std::align_val_t alignment)
+	{
+	if (auto block = allocateAligned(size, alignment))
+		return block;
+	throw std::bad_alloc();
+	}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+	{
+	return operator new(size, alignment);
+	}
+
+void *operator new(size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+	{
+	return allocateAligned(size, alignment);
+	}
+
+void *operator new[](size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept
+	{
+	return allocateAligned(size, alignment);
+	}
+
+void operator delete(void *block) noexcept { std::free(block); }
+void operator delete[](void *block) noexcept { std::free(block); }
+void operator delete(void *block, size_t) noexcept { std::free(block); }
+void operator delete[](void *block, size_t) noexcept { std::free(block); }
+void operator delete(void *block, std::nothrow_t const &) noexcept { std::free(block); }
+void operator delete[](void *block, std::nothrow_t const &) noexcept { std::free(block); }
+void operator delete(void *block, std::align_val_t) noexcept { freeAligned(block); }
+void operator delete[](void *block, std::align_val_t) noexcept { freeAligned(block); }
+void operator delete(void *block, size_t, std::align_val_t) noexcept { freeAligned(block); }
+void operator delete[](void *block, size_t, std::align_val_t) noexcept { freeAligned(block); }
+void operator delete(void *block, std::align_val_t, std::nothrow_t const &) noexcept { freeAligned(block); }
+void operator delete[](void *block, std::align_val_t, std::nothrow_t const &) noexcept { freeAligned(block); }
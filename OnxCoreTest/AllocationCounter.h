@@ -0,0 +1,25 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Counts every heap allocation in the process: AllocationCounter.cpp
+// replaces the global operator new, and PageAllocator reports the blocks it
+// maps itself. Cheap enough to leave on, so the profiler and benches can
+// show which frames still allocate; a warmed up frame shouldn't.
+class AllocationCounter
+{
+public:
+	static uint64_t allocations() { return _allocations.load(std::memory_order_relaxed); }
+	static uint64_t bytes() { return _bytes.load(std::memory_order_relaxed); }
+
+	static void record(size_t size)
+		{
+		_allocations.fetch_add(1, std::memory_order_relaxed);
+		_bytes.fetch_add(size, std::memory_order_relaxed);
+		}
+
+private:
+	static std::atomic<uint64_t> _allocations,
+		_bytes;
+};
@@ -0,0 +1,61 @@
+#include "FrameMemory.h"
+#include <atomic>
+#include "AllocationCounter.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+	{
+	std::atomic<bool> useHugePages { false };
+	}
+
+void setHugePages(bool enabled)
+	{
+	useHugePages = enabled;
+	}
+
+bool hugePages()
+	{
+	return useHugePages;
+	}
+
+// Rounded up to whole large pages, so huge pages can cover all of it
+void *allocatePages(size_t bytes)
+	{
+	bytes = (bytes + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE * LARGE_PAGE_SIZE;
+	AllocationCounter::record(bytes);
+
+#ifdef _WIN32
+	if (useHugePages && GetLargePageMinimum() > 0 && bytes % GetLargePageMinimum() == 0)
+		if (auto block = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE))
+			return block;
+	return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	auto block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (block == MAP_FAILED)
+		return nullptr;
+#ifdef MADV_HUGEPAGE
+	// only a hint, the kernel falls back to normal pages
+	if (useHugePages)
+		madvise(block, bytes, MADV_HUGEPAGE);
+#endif
+	return block;
+#endif
+	}
+
+void freePages(void *block, size_t bytes)
+	{
+#ifdef _WIN32
+	(void)bytes;
+	VirtualFree(block, 0, MEM_RELEASE);
+#else
+	bytes = (bytes + LARGE_PAGE_SIZE - 1) / LARGE_PAGE_SIZE * LARGE_PAGE_SIZE;
+	munmap(block, bytes);
+#endif
+	}
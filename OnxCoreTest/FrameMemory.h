@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <new>
+
+// Memory for the lists rebuilt every frame. The lists keep their capacity
+// from frame to frame, so once they've grown to fit the largest frame seen
+// nothing more is allocated; HighWaterMark reserves ahead of that growth,
+// and PageAllocator lets the big ones sit on huge pages.
+
+// Blocks of at least this size are mapped from the OS by PageAllocator
+constexpr size_t LARGE_PAGE_SIZE = size_t(2) << 20;
+
+void *allocatePages(size_t bytes);
+void freePages(void *block, size_t bytes);
+
+// Off by default; only affects blocks mapped after the call
+void setHugePages(bool enabled);
+bool hugePages();
+
+// std::vector allocator: small blocks come from operator new, large ones are
+// mapped directly and, with setHugePages, backed by huge pages where the OS
+// will give them (transparent huge pages on Linux, large pages on Windows
+// with the lock pages privilege)
+template <class T>
+struct PageAllocator
+	{
+	typedef T value_type;
+
+	PageAllocator() = default;
+	template <class U> PageAllocator(PageAllocator<U> const &) {}
+
+	T *allocate(size_t count)
+		{
+		auto bytes = count * sizeof(T);
+		if (bytes < LARGE_PAGE_SIZE)
+			return static_cast<T*>(::operator new(bytes));
+		if (auto block = allocatePages(bytes))
+			return static_cast<T*>(block);
+		throw std::bad_alloc();
+		}
+
+	void deallocate(T *block, size_t count)
+		{
+		auto bytes = count * sizeof(T);
+		if (bytes < LARGE_PAGE_SIZE)
+			::operator delete(block);
+		else
+			freePages(block, bytes);
+		}
+
+	template <class U> bool operator==(PageAllocator<U> const &) const { return true; }
+	template <class U> bool operator!=(PageAllocator<U> const &) const { return false; }
+	};
+
+// Capacity estimate for a list rebuilt every frame: the largest size seen,
+// decaying by 1/64th a frame so one outlier doesn't set it forever, plus
+// half again on top so a list growing a little each frame doesn't
+// reallocate each time it does
+class HighWaterMark
+{
+public:
+	void record(size_t size)
+		{
+		_peak = size > _peak ? size : _peak - (_peak >> 6);
+		}
+
+	size_t estimate() const { return _peak + (_peak >> 1); }
+
+	// Once the list no longer fits the peak, grows it to the estimate; never
+	// shrinks it
+	template <class List> void reserve(List &list) const
+		{
+		if (list.capacity() < _peak)
+			list.reserve(estimate());
+		}
+
+private:
+	size_t _peak = 0;
+};
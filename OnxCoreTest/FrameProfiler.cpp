@@ -0,0 +1,155 @@
+#include "FrameProfiler.h"
+#include "AllocationCounter.h"
+
+char const *FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = { "camera", "generate", "setup", "draw", "swap" };
+
+FrameProfiler::~FrameProfiler()
+{
+	if (_queries[0][0])
+		glDeleteQueries(2 * FRAME_PHASE_COUNT, &_queries[0][0]);
+	if (_log)
+		fclose(_log);
+}
+
+// One CSV row per frame, written as the frame's GPU times come in
+bool FrameProfiler::openLog(char const *path)
+	{
+	_log = fopen(path, "w");
+	if (!_log)
+		return false;
+
+	fprintf(_log, "frame,detail,maxDepth,tiles,nodes,allocations");
+	for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+		fprintf(_log, ",%sCpuUs", FRAME_PHASE_NAMES[phase]);
+	for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+		if (FRAME_PHASE_GPU[phase])
+			fprintf(_log, ",%sGpuUs", FRAME_PHASE_NAMES[phase]);
+	fprintf(_log, "\n");
+	_enabled = true;
+	return true;
+	}
+
+void FrameProfiler::beginFrame()
+	{
+	if (!_enabled)
+		return;
+
+	// Needs the context, so not done in the constructor
+	if (!_queries[0][0])
+		glGenQueries(2 * FRAME_PHASE_COUNT, &_queries[0][0]);
+
+	// This frame's queries were last used two frames ago, and should long
+	// since have finished
+	auto set = _frame & 1;
+	if (_pendingValid[set])
+		resolve(set, true);
+
+	auto &profile = _pending[set];
+	profile = {};
+	profile.frame = _frame;
+	_queriesIssued[set] = 0;
+	_traceFrame[set] = TraceRecorder::frame();
+	_frameStart = TraceRecorder::now();
+	_frameAllocations = AllocationCounter::allocations();
+	_inFrame = true;
+	}
+
+void FrameProfiler::begin(FramePhase phase)
+	{
+	if (!_inFrame)
+		return;
+
+	if (FRAME_PHASE_GPU[int(phase)])
+		{
+		glBeginQuery(GL_TIME_ELAPSED, _queries[_frame & 1][int(phase)]);
+		_queriesIssued[_frame & 1] |= 1u << int(phase);
+		}
+	_phaseStart[_frame & 1][int(phase)] = TraceRecorder::now();
+	}
+
+void FrameProfiler::end(FramePhase phase)
+	{
+	if (!_inFrame)
+		return;
+
+	auto set = _frame & 1;
+	auto start = _phaseStart[set][int(phase)],
+		end = TraceRecorder::now();
+	_pending[set].cpuMicroseconds[int(phase)] = float(end - start) * 0.001f;
+	if (FRAME_PHASE_GPU[int(phase)])
+		glEndQuery(GL_TIME_ELAPSED);
+	TraceRecorder::record(FRAME_PHASE_NAMES[int(phase)], "frame", start, end);
+	}
+
+// Files the frame's CPU times and picks up the previous frame's GPU times
+// if they're ready, without waiting for them
+void FrameProfiler::endFrame(float detail, TraversalStats const &stats)
+	{
+	if (!_inFrame)
+		return;
+
+	auto set = _frame & 1;
+	auto &profile = _pending[set];
+	profile.detail = detail;
+	profile.maxDepth = stats.maxDepth;
+	profile.tiles = stats.tiles;
+	profile.nodesVisited = stats.nodesVisited;
+	profile.allocations = int(AllocationCounter::allocations() - _frameAllocations);
+	_pendingValid[set] = true;
+	_inFrame = false;
+	TraceRecorder::record("frame", "frame", _frameStart, TraceRecorder::now());
+	++_frame;
+
+	if (_pendingValid[set ^ 1])
+		resolve(set ^ 1, false);
+	}
+
+// For frames that end up not drawing anything, before any of the GPU
+// phases have run
+void FrameProfiler::cancelFrame()
+	{
+	_inFrame = false;
+	}
+
+bool FrameProfiler::resolve(int set, bool wait)
+	{
+	auto &profile = _pending[set];
+	auto issued = _queriesIssued[set];
+	if (!wait)
+		for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+			if (issued & (1u << phase))
+				{
+				GLint available = GL_FALSE;
+				glGetQueryObjectiv(_queries[set][phase], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available)
+					return false;
+				}
+
+	for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+		if (issued & (1u << phase))
+			{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(_queries[set][phase], GL_QUERY_RESULT, &nanoseconds);
+			profile.gpuMicroseconds[phase] = float(nanoseconds) * 0.001f;
+			TraceRecorder::recordGpu(FRAME_PHASE_NAMES[phase], _phaseStart[set][phase], int64_t(nanoseconds), _traceFrame[set]);
+			}
+
+	_pendingValid[set] = false;
+	_lastProfile = profile;
+	writeLog(profile);
+	return true;
+	}
+
+void FrameProfiler::writeLog(FrameProfile const &profile)
+	{
+	if (!_log)
+		return;
+
+	fprintf(_log, "%d,%.3f,%d,%d,%d,%d", profile.frame, profile.detail, profile.maxDepth, profile.tiles, profile.nodesVisited, profile.allocations);
+	for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+		fprintf(_log, ",%.1f", profile.cpuMicroseconds[phase]);
+	for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase)
+		if (FRAME_PHASE_GPU[phase])
+			fprintf(_log, ",%.1f", profile.gpuMicroseconds[phase]);
+	fprintf(_log, "\n");
+	}
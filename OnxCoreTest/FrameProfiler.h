@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include "GLPlatform.h"
+#include "TileGenerator.h"
+#include "TraceRecorder.h"
+
+// The parts of OpenglWindow::Render that are timed, in the order they run
+enum class FramePhase
+	{
+	CameraUpdate,
+	GenerateTiles,
+	CameraSetup,
+	DrawSubmit,
+	SwapBuffers
+	};
+
+constexpr int FRAME_PHASE_COUNT = 5;
+extern char const *FRAME_PHASE_NAMES[FRAME_PHASE_COUNT];
+
+// Only the phases that issue GL commands get a GPU timer
+constexpr bool FRAME_PHASE_GPU[FRAME_PHASE_COUNT] = { false, false, true, true, true };
+
+// Where one frame's time went, and what it drew
+struct FrameProfile
+	{
+	int frame;
+	float cpuMicroseconds[FRAME_PHASE_COUNT];
+	float gpuMicroseconds[FRAME_PHASE_COUNT];	// 0 for phases without a GPU timer
+	float detail;
+	int maxDepth;
+	int tiles;
+	int nodesVisited;
+	int allocations;	// heap allocations on any thread between beginFrame and endFrame
+	};
+
+// Times each FramePhase on the CPU with a steady clock and on the GPU with
+// GL_TIME_ELAPSED queries. The queries are double buffered: a frame's
+// results are read back during the next one, so lastProfile() and the log
+// trail the frame being drawn by one. Phases mustn't overlap, GL doesn't
+// allow nested time queries. While a TraceRecorder is running every phase
+// and its GPU time is also recorded as a span.
+class FrameProfiler
+{
+public:
+	~FrameProfiler();
+
+	void setEnabled(bool enabled) { _enabled = enabled; }
+	bool enabled() const { return _enabled; }
+	bool openLog(char const *path);
+
+	void beginFrame();
+	void begin(FramePhase phase);
+	void end(FramePhase phase);
+	void endFrame(float detail, TraversalStats const &stats);
+	void cancelFrame();
+
+	// The newest frame with its GPU times in
+	FrameProfile const &lastProfile() const { return _lastProfile; }
+
+private:
+	bool _enabled = false,
+		_inFrame = false;
+	int _frame = 0;
+	FILE *_log = nullptr;
+	uint64_t _frameAllocations = 0;	// AllocationCounter at beginFrame
+	int64_t _frameStart = 0,	// TraceRecorder::now() nanoseconds
+		_phaseStart[2][FRAME_PHASE_COUNT] = {};
+	int _traceFrame[2] = {};
+	GLuint _queries[2][FRAME_PHASE_COUNT] = {};
+	FrameProfile _pending[2];		// waiting on the queries of the same index
+	bool _pendingValid[2] = {};
+	unsigned _queriesIssued[2] = {};	// bit per phase
+	FrameProfile _lastProfile = {};
+
+	bool resolve(int set, bool wait);
+	void writeLog(FrameProfile const &profile);
+};
+
+// Times a phase for the rest of the scope, a null profiler does nothing
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler *profiler, FramePhase phase) : _profiler(profiler), _phase(phase)
+		{
+		if (_profiler)
+			_profiler->begin(_phase);
+		}
+	~ProfileScope()
+		{
+		if (_profiler)
+			_profiler->end(_phase);
+		}
+
+private:
+	FrameProfiler *_profiler;
+	FramePhase _phase;
+};
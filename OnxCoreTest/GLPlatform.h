@@ -0,0 +1,37 @@
+#pragma once
+#include <cstring>
+
+// The Windows build loads GL entry points through GLEW. Linux builds
+// (ONX_SYSTEM_GL) link Mesa's libGL, which exports them all directly.
+#ifdef ONX_SYSTEM_GL
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glext.h>
+#else
+#include <glew.h>
+#endif
+
+// Whether the current context advertises an extension
+inline bool hasGLExtension(char const *name)
+	{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i)
+		if (strcmp((char const*)glGetStringi(GL_EXTENSIONS, GLuint(i)), name) == 0)
+			return true;
+	return false;
+	}
+
+// Whether glGenVertexArrays and friends can be used: GL 3.0 or
+// ARB_vertex_array_object
+inline bool hasVertexArrays()
+	{
+#ifdef ONX_SYSTEM_GL
+	// contexts older than 3.0 don't know GL_MAJOR_VERSION and leave it 0
+	GLint major = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	return major >= 3 || hasGLExtension("GL_ARB_vertex_array_object");
+#else
+	return GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+#endif
+	}
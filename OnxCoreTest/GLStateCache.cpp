@@ -0,0 +1,55 @@
+#include "GLStateCache.h"
+
+constexpr GLenum GLStateCache::CAPABILITIES[];
+
+void GLStateCache::invalidate()
+	{
+	for (auto &enabled : _enabled)
+		enabled = -1;
+	_polygonMode = 0;
+	_program = GLuint(-1);
+	_vertexArray = GLuint(-1);
+	}
+
+void GLStateCache::enable(GLenum capability, bool enabled)
+	{
+	int i = 0;
+	while (i < CAPABILITY_COUNT && CAPABILITIES[i] != capability)
+		++i;
+
+	if (i < CAPABILITY_COUNT)
+		{
+		if (_enabled[i] == int(enabled))
+			return;
+		_enabled[i] = int(enabled);
+		}
+
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+	}
+
+void GLStateCache::polygonMode(GLenum mode)
+	{
+	if (_polygonMode == mode)
+		return;
+	_polygonMode = mode;
+	glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+
+void GLStateCache::useProgram(GLuint program)
+	{
+	if (_program == program)
+		return;
+	_program = program;
+	glUseProgram(program);
+	}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+	{
+	if (_vertexArray == vertexArray)
+		return;
+	_vertexArray = vertexArray;
+	glBindVertexArray(vertexArray);
+	}
@@ -0,0 +1,26 @@
+#pragma once
+#include "GLPlatform.h"
+
+// Remembers the GL state it last set and skips calls that wouldn't change
+// anything. Only sees state changed through it; call invalidate() after
+// anything else may have touched it.
+class GLStateCache
+{
+public:
+	void invalidate();
+
+	void enable(GLenum capability, bool enabled);
+	void polygonMode(GLenum mode);
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+
+private:
+	// Capabilities the renderer toggles, anything else goes straight to GL
+	static constexpr int CAPABILITY_COUNT = 3;
+	static constexpr GLenum CAPABILITIES[CAPABILITY_COUNT] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND };
+
+	int _enabled[CAPABILITY_COUNT] = { -1, -1, -1 };	// -1 unknown
+	GLenum _polygonMode = 0;
+	GLuint _program = GLuint(-1);
+	GLuint _vertexArray = GLuint(-1);
+};
@@ -0,0 +1,100 @@
+#include "Heightfield.h"
+#include <algorithm>
+
+void HeightfieldProvider::elevations(float const *x, float const *y, size_t count, float *out) const
+	{
+	for (size_t i = 0; i < count; ++i)
+		out[i] = elevation(glm::vec2(x[i], y[i]));
+	}
+
+ProceduralTerrain::ProceduralTerrain(float amplitude, float frequency, int octaves, glm::vec2 const &offset)
+{
+	_noise.Amplitude = amplitude;
+	_noise.Frequency = frequency;
+	_noise.Octaves = octaves;
+	_noise.Offset = offset;
+}
+
+float ProceduralTerrain::elevation(glm::vec2 const &p) const
+	{
+	return fractalNoise(p, _noise);
+	}
+
+void ProceduralTerrain::elevations(float const *x, float const *y, size_t count, float *out) const
+	{
+	fractalBatch(x, y, count, _noise, out);
+	}
+
+Heightfield::Heightfield(HeightfieldProvider const &provider, int levels) :
+	  _levels(std::min(std::max(levels, 0), MAX_SUBDIVISION_DEPTH))
+	, _samplesPerSide((1 << _levels) + 1)
+{
+	auto spacing = 2.f * ROOT_HALF_SIZE / float(1 << _levels);
+	_samples.resize(size_t(_samplesPerSide) * _samplesPerSide);
+	std::vector<float> rowX(_samplesPerSide), rowY(_samplesPerSide);
+	for (int x = 0; x < _samplesPerSide; ++x)
+		rowX[x] = float(x) * spacing - ROOT_HALF_SIZE;
+	for (int y = 0; y < _samplesPerSide; ++y)
+		{
+		std::fill(rowY.begin(), rowY.end(), float(y) * spacing - ROOT_HALF_SIZE);
+		provider.elevations(rowX.data(), rowY.data(), rowX.size(), &_samples[size_t(y) * _samplesPerSide]);
+		}
+
+	size_t total = 0;
+	for (int depth = 0; depth <= _levels; ++depth)
+		{
+		_levelStart[depth] = total;
+		total += size_t(1) << (2 * depth);
+		}
+	_pyramid.resize(total);
+
+	// the finest level from each cell's corner samples, every level above
+	// from the four cells below it
+	auto cells = 1 << _levels;
+	auto finest = &_pyramid[_levelStart[_levels]];
+	for (int y = 0; y < cells; ++y)
+		for (int x = 0; x < cells; ++x)
+			{
+			auto corner = &_samples[size_t(y) * _samplesPerSide + x];
+			float const heights[] = { corner[0], corner[1], corner[_samplesPerSide], corner[_samplesPerSide + 1] };
+			finest[size_t(y) * cells + x] = glm::vec2(*std::min_element(heights, heights + 4), *std::max_element(heights, heights + 4));
+			}
+
+	for (int depth = _levels - 1; depth >= 0; --depth)
+		{
+		auto level = &_pyramid[_levelStart[depth]],
+			below = &_pyramid[_levelStart[depth + 1]];
+		auto side = 1 << depth;
+		for (int y = 0; y < side; ++y)
+			for (int x = 0; x < side; ++x)
+				{
+				auto first = below + size_t(2 * y) * (2 * side) + 2 * x;
+				glm::vec2 const children[] = { first[0], first[1], first[2 * side], first[2 * side + 1] };
+				level[size_t(y) * side + x] = glm::vec2(
+					std::min(std::min(children[0].x, children[1].x), std::min(children[2].x, children[3].x)),
+					std::max(std::max(children[0].y, children[1].y), std::max(children[2].y, children[3].y)));
+				}
+		}
+}
+
+// Bilinear between the samples around p, clamped to the root quad
+float Heightfield::height(glm::vec2 const &p) const
+	{
+	auto cells = float(1 << _levels);
+	auto grid = glm::clamp((p + ROOT_HALF_SIZE) * (cells / (2.f * ROOT_HALF_SIZE)), glm::vec2(0.f), glm::vec2(cells));
+	auto cell = glm::min(glm::ivec2(grid), glm::ivec2(_samplesPerSide - 2));
+	auto t = grid - glm::vec2(cell);
+
+	auto corner = &_samples[size_t(cell.y) * _samplesPerSide + cell.x];
+	auto bottom = glm::mix(corner[0], corner[1], t.x),
+		top = glm::mix(corner[_samplesPerSide], corner[_samplesPerSide + 1], t.x);
+	return glm::mix(bottom, top, t.y);
+	}
+
+// Elevation range of the tile at cell, depth (see makeTileKey)
+glm::vec2 Heightfield::range(glm::uvec2 const &cell, int depth) const
+	{
+	if (depth > _levels)
+		return _pyramid[_levelStart[_levels] + size_t(cell.y >> (depth - _levels)) * (size_t(1) << _levels) + (cell.x >> (depth - _levels))];
+	return _pyramid[_levelStart[depth] + size_t(cell.y) * (size_t(1) << depth) + cell.x];
+	}
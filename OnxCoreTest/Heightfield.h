@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <glm.hpp>
+#include "NoiseBatch.h"
+#include "Types.h"
+
+// The root quad is sampled on a grid of 2^levels cells a side
+constexpr int DEFAULT_HEIGHTFIELD_LEVELS = 9;
+
+// Where terrain elevations come from; sampled once into a Heightfield, a
+// row of samples at a time
+class HeightfieldProvider
+{
+public:
+	virtual ~HeightfieldProvider() {}
+	virtual float elevation(glm::vec2 const &p) const = 0;
+	// out[i] = elevation(vec2(x[i], y[i])), for providers that can do better
+	// than one point at a time
+	virtual void elevations(float const *x, float const *y, size_t count, float *out) const;
+};
+
+// Rolling hills: octaves of simplex noise, each at twice the frequency and
+// half the amplitude of the one before, sampled a batch at a time
+class ProceduralTerrain : public HeightfieldProvider
+{
+public:
+	explicit ProceduralTerrain(float amplitude = 0.6f, float frequency = 0.3f, int octaves = 6, glm::vec2 const &offset = glm::vec2(17.f, 5.f));
+	float elevation(glm::vec2 const &p) const override;
+	void elevations(float const *x, float const *y, size_t count, float *out) const override;
+
+private:
+	FractalNoise _noise;
+};
+
+// What the terrain traversal needs of the elevation: each quadtree node's
+// range, by the tile cell and depth of makeTileKey, and a hint as the
+// nodes are drawn so out of core terrain can read ahead
+class ElevationBounds
+{
+public:
+	virtual ~ElevationBounds() {}
+	virtual glm::vec2 range(glm::uvec2 const &cell, int depth) const = 0;	// min, max
+	// The node is being drawn; refining says it's near enough the detail
+	// threshold that its children are likely to be wanted next
+	virtual void prefetch(glm::uvec2 const &, int, bool) const {}
+};
+
+// Elevation over the root quad, z up: a provider sampled at the corners of
+// a 2^levels grid of cells, bilinear between them. Keeps a min/max pyramid
+// over the cells, level d matching the tiles at depth d, so a quadtree node
+// gets its elevation range with one lookup whatever its size; nodes deeper
+// than the grid use the cell they're in. The ranges are exact for the
+// bilinear surface, which is what the renderer draws.
+class Heightfield : public ElevationBounds
+{
+public:
+	explicit Heightfield(HeightfieldProvider const &provider, int levels = DEFAULT_HEIGHTFIELD_LEVELS);
+
+	int levels() const { return _levels; }
+	int samplesPerSide() const { return _samplesPerSide; }
+	std::vector<float> const &samples() const { return _samples; }	// rows of increasing y
+
+	float height(glm::vec2 const &p) const;
+	glm::vec2 range(glm::uvec2 const &cell, int depth) const override;
+	glm::vec2 range() const { return _pyramid[0]; }
+
+private:
+	int _levels,
+		_samplesPerSide;
+	std::vector<float> _samples;
+	std::vector<glm::vec2> _pyramid;	// level d's (2^d)^2 cells from _levelStart[d]
+	size_t _levelStart[MAX_SUBDIVISION_DEPTH + 1];
+};
@@ -0,0 +1,166 @@
+#include "InputLog.h"
+#include <cstring>
+
+namespace
+	{
+	char const MAGIC[4] = { 'O', 'N', 'X', 'I' };
+	}
+
+InputRecorder::~InputRecorder()
+{
+	close();
+}
+
+bool InputRecorder::open(char const *path)
+	{
+	close();
+	_file = fopen(path, "wb");
+	if (!_file)
+		return false;
+
+	fwrite(MAGIC, sizeof(MAGIC), 1, _file);
+	fwrite(&INPUT_LOG_VERSION, sizeof(INPUT_LOG_VERSION), 1, _file);
+	_frame = 0;
+	_start = std::chrono::steady_clock::now();
+	return true;
+	}
+
+// Ends the log with the frame count, so a replay runs as many frames as
+// the recording did even if the last ones had no input
+void InputRecorder::close()
+	{
+	if (!_file)
+		return;
+
+	InputEvent end = {};
+	end.Type = InputEventType::End;
+	write(end);
+	fclose(_file);
+	_file = nullptr;
+	}
+
+void InputRecorder::mousePosition(int x, int y)
+	{
+	if (!_file)
+		return;
+
+	InputEvent event = {};
+	event.Type = InputEventType::MousePosition;
+	event.X = int16_t(x);
+	event.Y = int16_t(y);
+	write(event);
+	}
+
+void InputRecorder::mouseButton(int button, bool down)
+	{
+	if (!_file)
+		return;
+
+	InputEvent event = {};
+	event.Type = InputEventType::MouseButton;
+	event.Button = uint8_t(button);
+	event.Down = down;
+	write(event);
+	}
+
+// Called as each frame starts; input from here on belongs to the next one
+void InputRecorder::nextFrame()
+	{
+	++_frame;
+	}
+
+void InputRecorder::write(InputEvent const &event)
+	{
+	auto type = uint8_t(event.Type);
+	auto microseconds = uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count());
+	fwrite(&type, sizeof(type), 1, _file);
+	fwrite(&_frame, sizeof(_frame), 1, _file);
+	fwrite(&microseconds, sizeof(microseconds), 1, _file);
+
+	if (event.Type == InputEventType::MousePosition)
+		{
+		fwrite(&event.X, sizeof(event.X), 1, _file);
+		fwrite(&event.Y, sizeof(event.Y), 1, _file);
+		}
+	else if (event.Type == InputEventType::MouseButton)
+		{
+		uint8_t down = event.Down;
+		fwrite(&event.Button, sizeof(event.Button), 1, _file);
+		fwrite(&down, sizeof(down), 1, _file);
+		}
+	}
+
+bool InputReplay::load(char const *path)
+	{
+	auto file = fopen(path, "rb");
+	if (!file)
+		{
+		fprintf(stderr, "could not read input log %s\n", path);
+		return false;
+		}
+
+	char magic[4];
+	uint32_t version = 0;
+	if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		fread(&version, sizeof(version), 1, file) != 1 || version != INPUT_LOG_VERSION)
+		{
+		fprintf(stderr, "%s is not a version %u input log\n", path, INPUT_LOG_VERSION);
+		fclose(file);
+		return false;
+		}
+
+	_events.clear();
+	_next = 0;
+	_frames = 0;
+	for (;;)
+		{
+		InputEvent event = {};
+		uint8_t type;
+		if (fread(&type, sizeof(type), 1, file) != 1 ||
+			fread(&event.Frame, sizeof(event.Frame), 1, file) != 1 ||
+			fread(&event.Microseconds, sizeof(event.Microseconds), 1, file) != 1)
+			break;
+
+		event.Type = InputEventType(type);
+		auto ok = true;
+		if (event.Type == InputEventType::MousePosition)
+			ok = fread(&event.X, sizeof(event.X), 1, file) == 1 && fread(&event.Y, sizeof(event.Y), 1, file) == 1;
+		else if (event.Type == InputEventType::MouseButton)
+			{
+			uint8_t down = 0;
+			ok = fread(&event.Button, sizeof(event.Button), 1, file) == 1 && fread(&down, sizeof(down), 1, file) == 1;
+			event.Down = down != 0;
+			}
+		else if (event.Type == InputEventType::End)
+			{
+			_frames = event.Frame;
+			break;
+			}
+		else
+			ok = false;
+
+		if (!ok)
+			break;
+		_events.push_back(event);
+		}
+	fclose(file);
+
+	// A log cut short, by a crash say, still replays up to its last event
+	if (_frames == 0 && !_events.empty())
+		_frames = _events.back().Frame + 1;
+	return true;
+	}
+
+// Feeds the camera everything that arrived before the frame started;
+// frames have to be applied in order
+void InputReplay::apply(int frame, OrbitCamera &camera)
+	{
+	for (; _next < _events.size() && int(_events[_next].Frame) <= frame; ++_next)
+		{
+		auto &event = _events[_next];
+		if (event.Type == InputEventType::MousePosition)
+			camera.setMousePosition(event.X, event.Y);
+		else
+			camera.setMouseButton(event.Button, event.Down);
+		}
+	}
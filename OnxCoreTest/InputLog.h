@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "OrbitCamera.h"
+
+// Mouse input captured from the window so an interaction can be rerun
+// exactly, as a benchmark. Events are tied to the frame they arrived
+// before, and replayed at the start of that frame, so the camera goes
+// through the same states whatever the timing of the replay. The wheel
+// arrives as buttons 3 and 4 and is recorded as such.
+//
+// File layout, little endian: "ONXI", uint32 version, then per event
+//   uint8 type, uint32 frame, uint32 microseconds since recording began
+//   MousePosition: int16 x, int16 y
+//   MouseButton:   uint8 button, uint8 down
+//   End:           nothing, frame is the number of frames recorded
+
+enum class InputEventType : uint8_t
+	{
+	MousePosition,
+	MouseButton,
+	End
+	};
+
+struct InputEvent
+	{
+	InputEventType Type;
+	uint32_t Frame;
+	uint32_t Microseconds;
+	int16_t X;
+	int16_t Y;
+	uint8_t Button;
+	bool Down;
+	};
+
+constexpr uint32_t INPUT_LOG_VERSION = 1;
+
+class InputRecorder
+{
+public:
+	~InputRecorder();
+
+	bool open(char const *path);
+	void close();
+	bool recording() const { return _file != nullptr; }
+
+	void mousePosition(int x, int y);
+	void mouseButton(int button, bool down);
+	void nextFrame();
+
+private:
+	FILE *_file = nullptr;
+	uint32_t _frame = 0;
+	std::chrono::steady_clock::time_point _start;
+
+	void write(InputEvent const &event);
+};
+
+class InputReplay
+{
+public:
+	bool load(char const *path);
+
+	int frames() const { return int(_frames); }
+	bool finished(int frame) const { return frame >= int(_frames); }
+	void apply(int frame, OrbitCamera &camera);
+
+private:
+	std::vector<InputEvent> _events;
+	size_t _next = 0;
+	uint32_t _frames = 0;
+};
@@ -0,0 +1,213 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// The pages [offset, offset + bytes) is on, false if it's outside the file
+bool MappedFile::pages(size_t offset, size_t bytes, size_t page, size_t &start, size_t &end) const
+	{
+	if (!_data || offset >= _size || bytes == 0)
+		return false;
+	start = offset / page * page;
+	end = offset + bytes > _size ? _size : offset + bytes;
+	return true;
+	}
+
+#ifdef _WIN32
+
+bool MappedFile::openRead(char const *path)
+	{
+	close();
+	_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+		{
+		_file = nullptr;
+		return false;
+		}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size))
+		{
+		close();
+		return false;
+		}
+	_size = size_t(size.QuadPart);
+	return map(false);
+	}
+
+bool MappedFile::create(char const *path, size_t bytes)
+	{
+	close();
+	_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+		{
+		_file = nullptr;
+		return false;
+		}
+
+	LARGE_INTEGER size;
+	size.QuadPart = LONGLONG(bytes);
+	if (!SetFilePointerEx(_file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(_file))
+		{
+		close();
+		return false;
+		}
+	_size = bytes;
+	return map(true);
+	}
+
+bool MappedFile::map(bool writable)
+	{
+	if (_size == 0)
+		return true;
+
+	_mapping = CreateFileMappingA(_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping)
+		_data = static_cast<uint8_t *>(MapViewOfFile(_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+	if (!_data)
+		{
+		close();
+		return false;
+		}
+	return true;
+	}
+
+void MappedFile::close()
+	{
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file)
+		CloseHandle(_file);
+	_data = nullptr;
+	_mapping = _file = nullptr;
+	_size = 0;
+	}
+
+void MappedFile::willNeed(size_t offset, size_t bytes) const
+	{
+	if (!_data || offset >= _size)
+		return;
+
+	WIN32_MEMORY_RANGE_ENTRY range = { _data + offset, offset + bytes > _size ? _size - offset : bytes };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+
+// Unlocking pages that aren't locked drops them from the working set,
+// modified ones go to the modified list to be written as usual
+void MappedFile::release(size_t offset, size_t bytes) const
+	{
+	SYSTEM_INFO system;
+	GetSystemInfo(&system);
+	size_t start, end;
+	if (pages(offset, bytes, system.dwPageSize, start, end))
+		VirtualUnlock(_data + start, end - start);
+	}
+
+#else
+
+bool MappedFile::openRead(char const *path)
+	{
+	close();
+	auto descriptor = open(path, O_RDONLY);
+	if (descriptor < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0)
+		{
+		::close(descriptor);
+		return false;
+		}
+	_size = size_t(status.st_size);
+	return map(descriptor, false);
+	}
+
+bool MappedFile::create(char const *path, size_t bytes)
+	{
+	close();
+	auto descriptor = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (descriptor < 0)
+		return false;
+
+	if (ftruncate(descriptor, off_t(bytes)) != 0)
+		{
+		::close(descriptor);
+		return false;
+		}
+	_size = bytes;
+	return map(descriptor, true);
+	}
+
+// The descriptor isn't needed once the file is mapped, it's closed either way
+bool MappedFile::map(int descriptor, bool writable)
+	{
+	void *data = nullptr;
+	if (_size)
+		data = mmap(nullptr, _size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (data == MAP_FAILED)
+		{
+		_size = 0;
+		return false;
+		}
+
+	_data = static_cast<uint8_t *>(data);
+	return true;
+	}
+
+void MappedFile::close()
+	{
+	if (_data)
+		munmap(_data, _size);
+	_data = nullptr;
+	_size = 0;
+	}
+
+// madvise wants a page aligned start
+void MappedFile::willNeed(size_t offset, size_t bytes) const
+	{
+	size_t start, end;
+	if (pages(offset, bytes, size_t(sysconf(_SC_PAGESIZE)), start, end))
+		madvise(_data + start, end - start, MADV_WILLNEED);
+	}
+
+// For a shared mapping this only unmaps the pages, dirty ones are kept in
+// the page cache and written back as usual, so a page another thread is
+// still writing just faults back in
+void MappedFile::release(size_t offset, size_t bytes) const
+	{
+	size_t start, end;
+	if (pages(offset, bytes, size_t(sysconf(_SC_PAGESIZE)), start, end))
+		madvise(_data + start, end - start, MADV_DONTNEED);
+	}
+
+#endif
+
+// Steps by the smallest page size either platform has, so no page is missed
+void MappedFile::touch(size_t offset, size_t bytes) const
+	{
+	if (!_data || !bytes || offset >= _size)
+		return;
+
+	auto end = offset + bytes > _size ? _size : offset + bytes;
+	uint8_t sum = 0;
+	for (auto at = offset; at < end; at += 4096)
+		sum += *static_cast<uint8_t volatile *>(_data + at);
+	sum += *static_cast<uint8_t volatile *>(_data + end - 1);
+	(void)sum;
+	}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped into memory: read only, or created at a fixed size
+// and mapped for writing, which is how the pyramid builder fills it in
+// parallel without any writes of its own
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	bool openRead(char const *path);
+	bool create(char const *path, size_t bytes);
+	void close();
+
+	uint8_t *data() const { return _data; }
+	size_t size() const { return _size; }
+
+	// Asks for [offset, offset + bytes) to be read in ahead of use
+	void willNeed(size_t offset, size_t bytes) const;
+	// Reads [offset, offset + bytes) in now, a byte a page, so it's
+	// resident before whoever reads it next gets to it
+	void touch(size_t offset, size_t bytes) const;
+	// Takes the pages of [offset, offset + bytes) back out of the process,
+	// so streaming through a file doesn't keep all of it resident; anything
+	// written there stays in the file and reads back in if touched again
+	void release(size_t offset, size_t bytes) const;
+
+private:
+	uint8_t *_data = nullptr;
+	size_t _size = 0;
+
+	bool pages(size_t offset, size_t bytes, size_t page, size_t &start, size_t &end) const;
+#ifdef _WIN32
+	void *_file = nullptr,
+		*_mapping = nullptr;
+
+	bool map(bool writable);
+#else
+	bool map(int descriptor, bool writable);
+#endif
+};
@@ -0,0 +1,329 @@
+#include "NoiseBatch.h"
+#include <algorithm>
+#include <gtc/noise.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NOISE_BATCH_AVX2
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define NOISE_BATCH_SSE4
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NOISE_BATCH_SSE2
+#else
+#include <cmath>
+#endif
+
+// The same thin wrappers as TileBatch.cpp, plus what the noise needs. min
+// and max only differ from glm's where it doesn't matter here, on NaN and
+// the sign of zero, which the noise squares away.
+namespace
+	{
+#if defined(NOISE_BATCH_AVX2)
+	typedef __m256 lanes;
+	typedef __m256 mask;
+	constexpr int LANES = 8;
+	constexpr char const *ISA = "AVX2";
+
+	inline lanes load(float const *p) { return _mm256_loadu_ps(p); }
+	inline void store(float *p, lanes v) { _mm256_storeu_ps(p, v); }
+	inline lanes splat(float v) { return _mm256_set1_ps(v); }
+	inline lanes add(lanes a, lanes b) { return _mm256_add_ps(a, b); }
+	inline lanes sub(lanes a, lanes b) { return _mm256_sub_ps(a, b); }
+	inline lanes mul(lanes a, lanes b) { return _mm256_mul_ps(a, b); }
+	inline lanes div(lanes a, lanes b) { return _mm256_div_ps(a, b); }
+	inline lanes abs(lanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+	inline lanes floor(lanes a) { return _mm256_floor_ps(a); }
+	inline lanes min(lanes a, lanes b) { return _mm256_min_ps(a, b); }
+	inline lanes max(lanes a, lanes b) { return _mm256_max_ps(a, b); }
+	inline mask lt(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline lanes select(mask m, lanes a, lanes b) { return _mm256_blendv_ps(b, a, m); }
+#elif defined(NOISE_BATCH_SSE4) || defined(NOISE_BATCH_SSE2)
+	typedef __m128 lanes;
+	typedef __m128 mask;
+	constexpr int LANES = 4;
+
+	inline lanes load(float const *p) { return _mm_loadu_ps(p); }
+	inline void store(float *p, lanes v) { _mm_storeu_ps(p, v); }
+	inline lanes splat(float v) { return _mm_set1_ps(v); }
+	inline lanes add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+	inline lanes sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+	inline lanes mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+	inline lanes div(lanes a, lanes b) { return _mm_div_ps(a, b); }
+	inline lanes abs(lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+	inline lanes min(lanes a, lanes b) { return _mm_min_ps(a, b); }
+	inline lanes max(lanes a, lanes b) { return _mm_max_ps(a, b); }
+	inline mask lt(lanes a, lanes b) { return _mm_cmplt_ps(a, b); }
+#if defined(NOISE_BATCH_SSE4)
+	constexpr char const *ISA = "SSE4.1";
+
+	inline lanes floor(lanes a) { return _mm_floor_ps(a); }
+	inline lanes select(mask m, lanes a, lanes b) { return _mm_blendv_ps(b, a, m); }
+#else
+	constexpr char const *ISA = "SSE2";
+
+	inline lanes select(mask m, lanes a, lanes b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	// No rounding instruction: truncate and step down where that went up.
+	// Past 2^23 every float is whole already (and may not fit an int).
+	inline lanes floor(lanes a)
+		{
+		auto truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+		auto floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmplt_ps(a, truncated), _mm_set1_ps(1.f)));
+		return select(_mm_cmplt_ps(abs(a), _mm_set1_ps(8388608.f)), floored, a);
+		}
+#endif
+#else
+	typedef float lanes;
+	typedef bool mask;
+	constexpr int LANES = 1;
+	constexpr char const *ISA = "scalar";
+
+	inline lanes load(float const *p) { return *p; }
+	inline void store(float *p, lanes v) { *p = v; }
+	inline lanes splat(float v) { return v; }
+	inline lanes add(lanes a, lanes b) { return a + b; }
+	inline lanes sub(lanes a, lanes b) { return a - b; }
+	inline lanes mul(lanes a, lanes b) { return a * b; }
+	inline lanes div(lanes a, lanes b) { return a / b; }
+	inline lanes abs(lanes a) { return std::abs(a); }
+	inline lanes floor(lanes a) { return std::floor(a); }
+	inline lanes min(lanes a, lanes b) { return b < a ? b : a; }
+	inline lanes max(lanes a, lanes b) { return a < b ? b : a; }
+	inline mask lt(lanes a, lanes b) { return a < b; }
+	inline lanes select(mask m, lanes a, lanes b) { return m ? a : b; }
+#endif
+
+	inline lanes fract(lanes a) { return sub(a, floor(a)); }
+
+	inline lanes mod289(lanes a)
+		{
+		return sub(a, mul(floor(mul(a, splat(1.f / 289.f))), splat(289.f)));
+		}
+
+	inline lanes permute(lanes a)
+		{
+		return mod289(mul(add(mul(a, splat(34.f)), splat(1.f)), a));
+		}
+
+	inline lanes taylorInvSqrt(lanes r)
+		{
+		return sub(splat(float(1.79284291400159)), mul(splat(float(0.85373472095314)), r));
+		}
+
+	// glm::simplex(vec2), see gtc/noise.inl for the derivation; the constants
+	// are rounded from double the way glm's T(...) casts round them
+	inline lanes simplex2(lanes const *v)
+		{
+		auto const cx = splat(float(0.211324865405187)),
+			cy = splat(float(0.366025403784439)),
+			cz = splat(float(-0.577350269189626)),
+			cw = splat(float(0.024390243902439)),
+			zero = splat(0.f),
+			one = splat(1.f),
+			half = splat(0.5f);
+
+		// first corner
+		auto skew = add(mul(v[0], cy), mul(v[1], cy));
+		lanes i[] = { floor(add(v[0], skew)), floor(add(v[1], skew)) };
+		auto unskew = add(mul(i[0], cx), mul(i[1], cx));
+		lanes const x0[] = { add(sub(v[0], i[0]), unskew), add(sub(v[1], i[1]), unskew) };
+
+		// the other two, the middle one along x first when x0.x > x0.y
+		lanes const i1[] = { select(lt(x0[1], x0[0]), one, zero), select(lt(x0[1], x0[0]), zero, one) };
+		lanes const x1[] = { sub(add(x0[0], cx), i1[0]), sub(add(x0[1], cx), i1[1]) };
+		lanes const x2[] = { add(x0[0], cz), add(x0[1], cz) };
+		lanes const *const corners[] = { x0, x1, x2 };
+
+		auto const m289 = splat(289.f);
+		for (auto &axis : i)
+			axis = sub(axis, mul(m289, floor(div(axis, m289))));
+		lanes const p[] =
+			{
+			permute(add(permute(i[1]), i[0])),
+			permute(add(add(permute(add(i[1], i1[1])), i[0]), i1[0])),
+			permute(add(add(permute(add(i[1], one)), i[0]), one))
+			};
+
+		lanes sum;
+		for (int c = 0; c < 3; ++c)
+			{
+			auto x = corners[c];
+			auto m = max(sub(half, add(mul(x[0], x[0]), mul(x[1], x[1]))), zero);
+			m = mul(m, m);
+			m = mul(m, m);
+
+			// gradients: 41 points over a line mapped onto a diamond
+			auto gx = sub(mul(splat(2.f), fract(mul(p[c], cw))), one);
+			auto h = sub(abs(gx), half);
+			auto a0 = sub(gx, floor(add(gx, half)));
+			m = mul(m, sub(splat(float(1.79284291400159)), mul(splat(float(0.85373472095314)), add(mul(a0, a0), mul(h, h)))));
+
+			auto term = mul(m, add(mul(a0, x[0]), mul(h, x[1])));
+			sum = c == 0 ? term : add(sum, term);
+			}
+		return mul(splat(130.f), sum);
+		}
+
+	// glm::simplex(vec3)
+	inline lanes simplex3(lanes const *v)
+		{
+		auto const cx = splat(float(1.0 / 6.0)),
+			cy = splat(float(1.0 / 3.0)),
+			zero = splat(0.f),
+			one = splat(1.f),
+			half = splat(0.5f);
+
+		// first corner
+		auto skew = add(add(mul(v[0], cy), mul(v[1], cy)), mul(v[2], cy));
+		lanes i[3];
+		for (int k = 0; k < 3; ++k)
+			i[k] = floor(add(v[k], skew));
+		auto unskew = add(add(mul(i[0], cx), mul(i[1], cx)), mul(i[2], cx));
+
+		// the other three, walking the axes in decreasing order of x0
+		lanes x0[3], g[3], l[3], i1[3], i2[3], x1[3], x2[3], x3[3];
+		for (int k = 0; k < 3; ++k)
+			x0[k] = add(sub(v[k], i[k]), unskew);
+		for (int k = 0; k < 3; ++k)
+			{
+			g[k] = select(lt(x0[k], x0[(k + 1) % 3]), zero, one);
+			l[k] = sub(one, g[k]);
+			}
+		for (int k = 0; k < 3; ++k)
+			{
+			i1[k] = min(g[k], l[(k + 2) % 3]);
+			i2[k] = max(g[k], l[(k + 2) % 3]);
+			x1[k] = add(sub(x0[k], i1[k]), cx);
+			x2[k] = add(sub(x0[k], i2[k]), cy);
+			x3[k] = sub(x0[k], half);
+			i[k] = mod289(i[k]);
+			}
+		lanes const *const corners[] = { x0, x1, x2, x3 };
+		lanes const *const offsets[] = { nullptr, i1, i2, nullptr };
+
+		// gradients: 7x7 points over a square mapped onto an octahedron
+		constexpr float n = float(0.142857142857);
+		auto const nsx = splat(n * 2.f),
+			nsy = splat(n * 0.5f - 1.f),
+			nsz = splat(n);
+
+		lanes terms[4];
+		for (int c = 0; c < 4; ++c)
+			{
+			lanes p;
+			if (c == 0)
+				p = permute(add(permute(add(permute(i[2]), i[1])), i[0]));
+			else if (c == 3)
+				p = permute(add(add(permute(add(add(permute(add(i[2], one)), i[1]), one)), i[0]), one));
+			else
+				{
+				auto offset = offsets[c];
+				p = permute(add(add(permute(add(add(permute(add(i[2], offset[2])), i[1]), offset[1])), i[0]), offset[0]));
+				}
+
+			auto j = sub(p, mul(splat(49.f), floor(mul(mul(p, nsz), nsz))));
+			auto gridX = floor(mul(j, nsz));
+			auto gridY = floor(sub(j, mul(splat(7.f), gridX)));
+			auto gx = add(mul(gridX, nsx), nsy),
+				gy = add(mul(gridY, nsx), nsy);
+			auto gz = sub(sub(one, abs(gx)), abs(gy));
+
+			auto sh = select(lt(zero, gz), splat(-0.f), splat(-1.f));
+			gx = add(gx, mul(add(mul(floor(gx), splat(2.f)), one), sh));
+			gy = add(gy, mul(add(mul(floor(gy), splat(2.f)), one), sh));
+
+			auto norm = taylorInvSqrt(add(add(mul(gx, gx), mul(gy, gy)), mul(gz, gz)));
+			gx = mul(gx, norm);
+			gy = mul(gy, norm);
+			gz = mul(gz, norm);
+
+			auto x = corners[c];
+			auto m = max(sub(splat(float(0.6)), add(add(mul(x[0], x[0]), mul(x[1], x[1])), mul(x[2], x[2]))), zero);
+			m = mul(m, m);
+			terms[c] = mul(mul(m, m), add(add(mul(gx, x[0]), mul(gy, x[1])), mul(gz, x[2])));
+			}
+		return mul(splat(42.f), add(add(terms[0], terms[1]), add(terms[2], terms[3])));
+		}
+
+	inline lanes fractal(lanes const *v, FractalNoise const &noise)
+		{
+		auto const offsetX = splat(noise.Offset.x),
+			offsetY = splat(noise.Offset.y);
+		auto height = splat(0.f);
+		auto amplitude = noise.Amplitude,
+			frequency = noise.Frequency;
+		for (int octave = 0; octave < noise.Octaves; ++octave)
+			{
+			auto f = splat(frequency);
+			lanes const p[] = { add(mul(v[0], f), offsetX), add(mul(v[1], f), offsetY) };
+			height = add(height, mul(splat(amplitude), simplex2(p)));
+			amplitude *= noise.Gain;
+			frequency *= noise.Lacunarity;
+			}
+		return height;
+		}
+
+	// Runs kernel over count points LANES at a time, the last partial batch
+	// padded with copies of the final point
+	template <size_t N, class Kernel>
+	void runBatch(float const *const (&in)[N], size_t count, float *out, Kernel const &kernel)
+		{
+		lanes v[N];
+		size_t i = 0;
+		for (; i + LANES <= count; i += LANES)
+			{
+			for (size_t k = 0; k < N; ++k)
+				v[k] = load(in[k] + i);
+			store(out + i, kernel(v));
+			}
+
+		if (i == count)
+			return;
+
+		float padded[N][LANES], result[LANES];
+		for (size_t k = 0; k < N; ++k)
+			{
+			for (int l = 0; l < LANES; ++l)
+				padded[k][l] = in[k][std::min(i + size_t(l), count - 1)];
+			v[k] = load(padded[k]);
+			}
+		store(result, kernel(v));
+		std::copy(result, result + (count - i), out + i);
+		}
+	}
+
+const int NOISE_LANES = LANES;
+const char* const NOISE_ISA = ISA;
+
+void simplexBatch(float const *x, float const *y, size_t count, float *out)
+	{
+	float const *const in[] = { x, y };
+	runBatch(in, count, out, [](lanes const *v) { return simplex2(v); });
+	}
+
+void simplexBatch(float const *x, float const *y, float const *z, size_t count, float *out)
+	{
+	float const *const in[] = { x, y, z };
+	runBatch(in, count, out, [](lanes const *v) { return simplex3(v); });
+	}
+
+void fractalBatch(float const *x, float const *y, size_t count, FractalNoise const &noise, float *out)
+	{
+	float const *const in[] = { x, y };
+	runBatch(in, count, out, [&noise](lanes const *v) { return fractal(v, noise); });
+	}
+
+float fractalNoise(glm::vec2 const &p, FractalNoise const &noise)
+	{
+	float height = 0,
+		amplitude = noise.Amplitude,
+		frequency = noise.Frequency;
+	for (int octave = 0; octave < noise.Octaves; ++octave)
+		{
+		height += amplitude * glm::simplex(p * frequency + noise.Offset);
+		amplitude *= noise.Gain;
+		frequency *= noise.Lacunarity;
+		}
+	return height;
+	}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <glm.hpp>
+
+// glm::simplex for many points at once, NOISE_LANES of them per instruction.
+// Each lane does exactly the float operations glm's scalar code does, in the
+// same order, so the results are bit for bit the same (0 ULPs) unless the
+// compiler fuses multiplies and adds into FMAs (-mfma, -march=native), which
+// it does differently on the two sides. Then they stay within 2^-22 of each
+// other, 2 ULPs at 1.0; near zero that's many ULPs of the tiny value itself.
+// OnxCoreBench --noise measures both the difference and the throughput.
+
+// Octaves of simplex noise, each at lacunarity times the frequency and gain
+// times the amplitude of the one before
+struct FractalNoise
+	{
+	float Amplitude = 1.f;
+	float Frequency = 1.f;
+	int Octaves = 1;
+	glm::vec2 Offset = glm::vec2(0.f);	// added after scaling by the frequency
+	float Lacunarity = 2.f;
+	float Gain = 0.5f;
+	};
+
+// out[i] = glm::simplex(vec2(x[i], y[i]))
+void simplexBatch(float const *x, float const *y, size_t count, float *out);
+// out[i] = glm::simplex(vec3(x[i], y[i], z[i]))
+void simplexBatch(float const *x, float const *y, float const *z, size_t count, float *out);
+
+// out[i] = fractalNoise(vec2(x[i], y[i]), noise), the octaves summed without
+// leaving the registers
+void fractalBatch(float const *x, float const *y, size_t count, FractalNoise const &noise, float *out);
+// The scalar reference for fractalBatch
+float fractalNoise(glm::vec2 const &p, FractalNoise const &noise);
+
+extern const int NOISE_LANES;
+extern const char* const NOISE_ISA;
@@ -3,30 +3,19 @@
 #include <stdlib.h>
 #include <glew.h>
 #include <freeglut.h>
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <string>
-#include <vector>
+#include "FrameProfiler.h"
+#include "InputLog.h"
+#include "OrbitCamera.h"
+#include "TileGenerator.h"
+#include "TileRenderer.h"
 #include "Types.h"
 
 #ifndef _OGLWINDOW_H_
 #define _OGLWINDOW_H_
 
-#define MAX_MOUSE_BUTTONS GLUT_RIGHT_BUTTON + 1
-
-constexpr float PI = 3.141592653589793238463f;
-constexpr float HALF_PI = PI * 0.5f;
-constexpr int WINDOW_WIDTH = 1280;
-constexpr int WINDOW_HEIGHT = 720;
-constexpr int MAX_SUBDIVISION_DEPTH = 20;
-
-struct MouseButton
-	{
-	bool state;
-	int stateTime;
-	};
-
+// The GLUT front end: feeds window input to the camera, or replays
+// recorded input in its place, and draws the generated tiles into the
+// window whenever they change
 class OpenglWindow
 {
 
@@ -34,42 +23,26 @@ public:
 	OpenglWindow(void);
 	~OpenglWindow(void);
 	void Render();
-	GLuint setupShader(char* vertPath, char* pixelPath);
 	void setMousePosition(int x, int y);
 	void setMouseButton(int button, int state);
+	TileGenerator &tileGenerator() { return _tileGenerator; }
+	TileRenderer &tileRenderer() { return _tileRenderer; }
+	FrameProfiler &profiler() { return _profiler; }
+	void setProfileOverlay(bool overlay);
+	bool recordInput(char const *path) { return _inputRecorder.open(path); }
+	bool replayInput(char const *path);
+	bool replaying() const { return _replaying; }
+	bool replayFinished() const { return _replaying && _inputReplay.finished(_frame); }
+	int frame() const { return _frame; }
 private:
-	float _orbitXZ,
-			_orbitYZ,
-			_distance = 10,
-			_detail = 0.2f,
-			_fov = 45.0f,
-			_aspect = float(WINDOW_WIDTH) / float(WINDOW_HEIGHT),
-			_nearClip = .5f,
-			_farClip = 50.f;
-
-	bool _cameraMoved = true;
-	int _maxFrameDetail = 0;
-
-	MouseButton _mouseButtons[MAX_MOUSE_BUTTONS];
-	MouseButton &_lmb = _mouseButtons[GLUT_LEFT_BUTTON],
-				&_rmb = _mouseButtons[GLUT_RIGHT_BUTTON];
-
-	std::vector<Tile> _tiles;
-	char* vertShaderText;
-	char* pixelShaderText;
-	GLuint mColorShader;
-	GLint mColorLoc;
-	glm::mat4x4 _viewMatrix,
-		_projMatrix,
-		_viewProjMatrix;
-	glm::vec3 _cameraPosition,
-		_focusPosition;
-
-	void updateCamera();
-	void updateCameraDistance();
-	void setDetailLevel(float detail);
-	bool generateTiles(glm::vec2 const p1, glm::vec2 const p2, int const depth);
-	void setDeviceCamera();
-	void setDebugCamera();
+	OrbitCamera _camera;
+	TileGenerator _tileGenerator;
+	TileRenderer _tileRenderer;
+	FrameProfiler _profiler;
+	bool _profileOverlay = false;
+	InputRecorder _inputRecorder;
+	InputReplay _inputReplay;
+	bool _replaying = false;
+	int _frame = 0;
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,153 @@
+#include "OrbitCamera.h"
+#include <gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+OrbitCamera::OrbitCamera()
+	{
+	memset(&_mouseButtons, 0, sizeof(_mouseButtons));
+	setMousePosition(WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
+	}
+
+// Generate a modelview matrix
+glm::mat4x4 lookAt(glm::vec3 const &eye, glm::vec3 const &focus, glm::vec3 const &up)
+	{
+	auto zaxis = glm::normalize(eye - focus);
+	auto xaxis = glm::normalize(glm::cross(zaxis, up));
+	auto yaxis = glm::cross(xaxis, zaxis);
+
+	auto xdot = dot(xaxis, eye),
+		ydot = dot(yaxis, eye),
+		zdot = dot(zaxis, eye);
+
+	return glm::mat4x4(
+					xaxis.x, yaxis.x, zaxis.x, 0.f,
+					xaxis.y, yaxis.y, zaxis.y, 0,
+					xaxis.z, yaxis.z, zaxis.z, 0,
+					-xdot, -ydot, -zdot, 1.f
+					);
+	}
+
+// Generate a perspective projection matrix
+glm::mat4x4 perspective(float fov, float aspect, float znear, float zfar)
+	{
+	float yscale = 1 / tan(0.5f * fov);
+	float xscale = yscale / aspect;
+
+	return glm::mat4x4
+		(
+		xscale, 0, 0, 0,
+		0, yscale, 0, 0,
+		0, 0, zfar / (znear - zfar), -1,
+		0, 0, znear * zfar / (znear - zfar), 0
+		);
+	}
+
+void OrbitCamera::updateCameraDistance()
+	{
+	if (_lmb.state ^ _rmb.state)
+		{
+		// These min/max extents should be dependent on _detail
+		if (_lmb.state && !_rmb.state)
+			_distance = std::max(_distance * 0.97f, 0.00001f);
+		else if (_rmb.state)
+			_distance = std::min(_distance * 1.03f, 20.f);
+		updateCamera();
+		}
+	}
+
+// Drives the near/far clip plane
+void OrbitCamera::setDetailLevel(float detail)
+	{
+	_detail = std::min(std::max(detail, 0.05f), 1.5f);
+	updateCamera();
+	}
+
+// Update view/projection matrices used to generate the displayed tiles
+void OrbitCamera::updateCamera()
+	{
+	auto posYZ = glm::vec3(0, std::sin(_orbitYZ * HALF_PI), std::cos(_orbitYZ * HALF_PI));
+	auto posXZ = glm::vec3(posYZ.y * std::sin(_orbitXZ * PI * 2), posYZ.y * std::cos(_orbitXZ * PI * 2), posYZ.z);
+
+	_cameraPosition = posXZ * _distance;
+	_focusPosition = glm::vec3(0, 0, 0);
+
+	_viewMatrix = lookAt(_cameraPosition, _focusPosition, glm::vec3(0, 0, 1));
+
+	float angle = 45.0f;
+	float ratio = 1280.0f / 720.0f;
+	_nearClip = std::min(_distance * 0.05f, 1.f);
+	_farClip = _nearClip * 100.f;
+
+	_projMatrix = perspective(_fov, _aspect, _nearClip, _farClip);
+	_viewProjMatrix = _projMatrix * _viewMatrix;
+
+	// The view is drawn with _fov in degrees, as gluPerspective took it;
+	// the tile generators get it in radians above, a wider view that they
+	// have always refined for, so that's left alone
+	_deviceViewProjMatrix = glm::perspective(glm::radians(_fov), _aspect, _nearClip, _farClip) *
+		glm::lookAt(_cameraPosition, _focusPosition, glm::vec3(0, 0, 1));
+	_cameraMoved = true;
+	}
+
+// Snapshot of the camera for the tile generators
+CameraState OrbitCamera::cameraState() const
+	{
+	CameraState camera;
+	camera.ViewProj = _viewProjMatrix;
+	camera.Position = _cameraPosition;
+	camera.Focus = _focusPosition;
+	camera.TanHalfFov = glm::vec2(1.f / _projMatrix[0][0], 1.f / _projMatrix[1][1]);
+	camera.FarClip = _farClip;
+	camera.Detail = _detail;
+	return camera;
+	}
+
+// Mouse move events, the x position picks the angle around the
+// origin, the y position the angle above the ground
+void OrbitCamera::setMousePosition(int x, int y)
+	{
+	_orbitXZ = (float)x / WINDOW_WIDTH;
+	_orbitYZ = std::max(0.05f, std::min(float(y) / WINDOW_HEIGHT, 0.95f)); // Prevent looking straight down
+	updateCamera();
+	}
+
+// Mouse button events, see OrbitButton.  Wheel up increases detail
+// level, wheel down decreases detail
+void OrbitCamera::setMouseButton(int button, bool down)
+	{
+	if (button >= 0 && button < MAX_MOUSE_BUTTONS)
+		{
+		_mouseButtons[button].state = down;
+		_mouseButtons[button].stateTime = 0;
+		_cameraMoved = true;
+		}
+	else if (button == ORBIT_WHEEL_UP && down)
+		setDetailLevel(_detail * 0.9f);
+	else if (button == ORBIT_WHEEL_DOWN && down)
+		setDetailLevel(_detail * 1.1f);
+	}
+
+// Places the camera directly, for scripted camera paths; unlike the mouse
+// nothing is clamped
+void OrbitCamera::setOrbit(float orbitXZ, float orbitYZ, float distance, float detail)
+	{
+	_orbitXZ = orbitXZ;
+	_orbitYZ = orbitYZ;
+	_distance = distance;
+	_detail = detail;
+	updateCamera();
+	}
+
+// Once per frame: returns whether the camera moved since the last call,
+// zooming first if a button is held (which keeps it moving next frame too)
+bool OrbitCamera::update()
+	{
+	if (!_cameraMoved)
+		return false;
+
+	_cameraMoved = false;
+	updateCameraDistance();
+	return true;
+	}
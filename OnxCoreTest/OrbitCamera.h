@@ -0,0 +1,81 @@
+#pragma once
+#include <glm.hpp>
+#include "TraceRecorder.h"
+#include "Types.h"
+
+constexpr float PI = 3.141592653589793238463f;
+constexpr float HALF_PI = PI * 0.5f;
+constexpr int WINDOW_WIDTH = 1280;
+constexpr int WINDOW_HEIGHT = 720;
+
+// Mouse buttons numbered the way GLUT reports them; the wheel comes through
+// as buttons 3 and 4, which GLUT has no constants for
+enum OrbitButton
+	{
+	ORBIT_LEFT_BUTTON = 0,
+	ORBIT_MIDDLE_BUTTON = 1,
+	ORBIT_RIGHT_BUTTON = 2,
+	ORBIT_WHEEL_UP = 3,
+	ORBIT_WHEEL_DOWN = 4
+	};
+
+constexpr int MAX_MOUSE_BUTTONS = ORBIT_RIGHT_BUTTON + 1;
+
+struct MouseButton
+	{
+	bool state;
+	int stateTime;
+	};
+
+// The camera orbiting the origin: the mouse position picks the orbit angles,
+// holding the left or right button zooms in or out, the wheel changes the
+// detail level. No windowing code, the window feeds it its input events and
+// a headless driver can feed it scripted ones.
+class OrbitCamera
+{
+public:
+	OrbitCamera();
+
+	void setMousePosition(int x, int y);
+	void setMouseButton(int button, bool down);
+	void setOrbit(float orbitXZ, float orbitYZ, float distance, float detail);
+	bool update();
+
+	CameraState cameraState() const;
+	glm::mat4x4 const &deviceViewProj() const { return _deviceViewProjMatrix; }
+	bool buttonDown(int button) const { return _mouseButtons[button].state; }
+	glm::vec3 const &position() const { return _cameraPosition; }
+	glm::vec3 const &focus() const { return _focusPosition; }
+	float fov() const { return _fov; }
+	float aspect() const { return _aspect; }
+	float nearClip() const { return _nearClip; }
+	float farClip() const { return _farClip; }
+	TraceCamera traceCamera() const { return { _orbitXZ, _orbitYZ, _distance, _detail }; }
+
+private:
+	float _orbitXZ,
+			_orbitYZ,
+			_distance = 10,
+			_detail = 0.2f,
+			_fov = 45.0f,
+			_aspect = float(WINDOW_WIDTH) / float(WINDOW_HEIGHT),
+			_nearClip = .5f,
+			_farClip = 50.f;
+
+	bool _cameraMoved = true;
+
+	MouseButton _mouseButtons[MAX_MOUSE_BUTTONS];
+	MouseButton &_lmb = _mouseButtons[ORBIT_LEFT_BUTTON],
+				&_rmb = _mouseButtons[ORBIT_RIGHT_BUTTON];
+
+	glm::mat4x4 _viewMatrix,
+		_projMatrix,
+		_viewProjMatrix,
+		_deviceViewProjMatrix;	// what's drawn, see updateCamera
+	glm::vec3 _cameraPosition,
+		_focusPosition;
+
+	void updateCamera();
+	void updateCameraDistance();
+	void setDetailLevel(float detail);
+};
@@ -0,0 +1,542 @@
+#include "PersistentQuadtree.h"
+#include <cmath>
+#include <cstring>
+
+// Fraction of the estimated slack a node is allowed to use up before it's
+// looked at again; the estimates below are first order so leave headroom
+constexpr float RECHECK_SAFETY = 0.5f;
+// Of the same slack, the share a change of detail level may use; the
+// change is exact rather than estimated, and the two together stay under
+// the whole margin
+constexpr float DETAIL_SHARE = 0.25f;
+
+// Positive doubles order the same as their bits
+static uint64_t deadlineKey(double deadline)
+	{
+	deadline = std::max(deadline, 0.0);
+	uint64_t key;
+	memcpy(&key, &deadline, sizeof(key));
+	return key;
+	}
+
+void DeadlineQueue::clear()
+	{
+	for (auto &bucket : _buckets)
+		bucket.clear();
+	_last = 0;
+	_size = 0;
+	}
+
+// 0 for the last key taken out, otherwise 1 + the highest bit they differ in
+int DeadlineQueue::bucket(uint64_t key) const
+	{
+	auto bits = key ^ _last;
+#if defined(__GNUC__)
+	return bits ? 64 - __builtin_clzll(bits) : 0;
+#else
+	int width = 0;
+	for (int shift = 32; shift > 0; shift >>= 1)
+		if (bits >> shift)
+			{
+			bits >>= shift;
+			width += shift;
+			}
+	return width + int(bits);
+#endif
+	}
+
+void DeadlineQueue::push(double deadline, int node, unsigned schedule)
+	{
+	auto key = deadlineKey(deadline);
+	_buckets[bucket(key)].push_back({ key, node, schedule });
+	++_size;
+	}
+
+// Every key in a bucket below the clock's is before it, and the buckets
+// above it don't change with the clock as the last key; only the clock's
+// own bucket is split, its later entries dropping to lower buckets
+void DeadlineQueue::takeBefore(double clock, std::vector<Entry> &taken)
+	{
+	auto const now = deadlineKey(clock);
+	if (now <= _last)
+		return;
+
+	auto const split = bucket(now);
+	for (int i = 0; i < split; ++i)
+		{
+		taken.insert(taken.end(), _buckets[i].begin(), _buckets[i].end());
+		_size -= _buckets[i].size();
+		_buckets[i].clear();
+		}
+
+	_last = now;
+	_kept.clear();
+	for (auto &entry : _buckets[split])
+		if (entry.key < now)
+			{
+			taken.push_back(entry);
+			--_size;
+			}
+		else
+			_kept.push_back(entry);
+	_buckets[split].clear();
+	for (auto &entry : _kept)
+		_buckets[bucket(entry.key)].push_back(entry);
+	}
+
+void PersistentQuadtree::reset()
+	{
+	_nodes.clear();
+	_freeBlocks.clear();
+	_tileNodes.clear();
+	std::fill(std::begin(_depthCounts), std::end(_depthCounts), 0);
+
+	_rechecks.clear();
+	_detailRechecks.clear();
+	_splitQueue.clear();
+	_mergeQueue.clear();
+	_due.clear();
+	_nextDue.clear();
+
+	_valid = false;
+	_travel = _detailTravel = 0;
+	}
+
+// Brings the tree and the tile list up to date with the camera. tiles must
+// be left alone between calls, leaves keep their slot in it across frames.
+void PersistentQuadtree::update(CameraState const &camera, TileList &tiles)
+	{
+	_tiles = &tiles;
+	_evaluated = _splits = _merges = 0;
+
+	_focusDistance = std::max(glm::distance(camera.Focus, camera.Position), 1e-12f);
+	for (int i = 0; i < 4; ++i)
+		{
+		// x >= -w, x <= w, y >= -w, y <= w; the sides go through the camera
+		auto const &m = camera.ViewProj;
+		auto const axis = i / 2;
+		auto const sign = i & 1 ? -1.f : 1.f;
+		_sides[i] = glm::normalize(glm::vec3(m[0][3] + sign * m[0][axis], m[1][3] + sign * m[1][axis], m[2][3] + sign * m[2][axis]));
+		}
+	_farClip = camera.FarClip;
+
+	if (!_valid)
+		{
+		reset();
+		tiles.clear();
+		_valid = true;
+		_detail = camera.Detail;
+		_position = camera.Position;
+
+		QuadNode root = { glm::vec2(5, 5), glm::vec2(-5, -5), {}, 0, -1, -1, -1, 0, 0, 0, false, true };
+		_nodes.push_back(root);
+		_due.push_back(0);
+		}
+	else
+		{
+		_travel += glm::distance(camera.Position, _position);
+		_position = camera.Position;
+
+		// a new detail level moves every length's ratio to it by the same
+		// factor, whichever way it went
+		if (camera.Detail != _detail)
+			_detailTravel += std::abs(std::log(double(camera.Detail) / _detail));
+		_detail = camera.Detail;
+
+		dueBefore(_rechecks, _travel);
+		dueBefore(_detailRechecks, _detailTravel);
+		}
+
+	// splits and newly refined quadrants bring children to evaluate; keep
+	// going until the tree settles for this camera
+	while (!_due.empty())
+		{
+		evaluateDue(camera);
+
+		while (!_mergeQueue.empty())
+			{
+			auto ranked = _mergeQueue.top();
+			_mergeQueue.pop();
+
+			auto &node = _nodes[ranked.node];
+			if (node.stamp != ranked.stamp || isLeaf(ranked.node))
+				continue;
+
+			release(ranked.node);
+			if (node.visible)
+				showTile(ranked.node);
+			schedule(ranked.node);
+			++_merges;
+			}
+
+		while (!_splitQueue.empty())
+			{
+			auto ranked = _splitQueue.top();
+			_splitQueue.pop();
+
+			if (_nodes[ranked.node].stamp != ranked.stamp || !isLeaf(ranked.node))
+				continue;
+
+			split(ranked.node);
+			schedule(ranked.node);
+			++_splits;
+			}
+
+		std::swap(_due, _nextDue);
+		_nextDue.clear();
+		}
+	}
+
+int PersistentQuadtree::maxDepth() const
+	{
+	for (int depth = MAX_SUBDIVISION_DEPTH; depth > 0; --depth)
+		if (_depthCounts[depth] > 0)
+			return depth;
+	return 0;
+	}
+
+// Whether the node decides for itself, as opposed to being a quadrant its
+// parent draws as it is
+bool PersistentQuadtree::isEvaluated(int index) const
+	{
+	auto parent = _nodes[index].parent;
+	return parent < 0 || ((_nodes[parent].quadrants >> (index - _nodes[parent].children)) & 1) != 0;
+	}
+
+// Classifies every due node in one batch and files it: leaves that need
+// refining go to the split queue and nodes that no longer do to the merge
+// queue; the rest get their tiles or quadrants updated and are rescheduled
+void PersistentQuadtree::evaluateDue(CameraState const &camera)
+	{
+	// drop duplicates and nodes that were freed since they were queued
+	size_t kept = 0;
+	for (auto index : _due)
+		if (_nodes[index].pending)
+			{
+			_nodes[index].pending = false;
+			_due[kept++] = index;
+			}
+	_due.resize(kept);
+
+	_dueFrontier.clear();
+	for (auto index : _due)
+		{
+		_nodes[index].pending = true;
+		_dueFrontier.push(_nodes[index].p1, _nodes[index].p2);
+		}
+
+	classifyNodes(_dueFrontier, camera.ViewProj, camera.Detail, _classified);
+	_evaluated += int(_due.size());
+
+	for (size_t i = 0; i < _due.size(); ++i)
+		{
+		// an earlier node in the batch can have freed it or made it a
+		// quadrant its parent draws
+		auto index = _due[i];
+		auto &node = _nodes[index];
+		if (!node.pending)
+			continue;
+		node.pending = false;
+
+		node.visible = !_classified.culled[i];
+		for (int e = 0; e < 4; ++e)
+			node.lengths[e] = _classified.length[e][i];
+		auto const error = std::max(std::max(node.lengths[0], node.lengths[1]), std::max(node.lengths[2], node.lengths[3]));
+
+		// an edge that's too long refines the two quadrants along it, same as generateTiles
+		unsigned quadrants = 0;
+		if (node.visible)
+			{
+			unsigned const refine = _classified.refine[i];
+			quadrants = refine | ((refine << 1) & 0xf) | (refine >> 3);
+			}
+
+		if (isLeaf(index))
+			{
+			if (quadrants)
+				{
+				node.quadrants = uint8_t(quadrants);
+				_splitQueue.push({ error, index, node.stamp });
+				continue;
+				}
+
+			if (node.visible)
+				showTile(index);
+			else
+				hideTile(index);
+			}
+		else if (!quadrants)
+			{
+			_mergeQueue.push({ error, index, node.stamp });
+			continue;
+			}
+		else
+			setQuadrants(index, quadrants);
+
+		schedule(index);
+		}
+
+	_due.clear();
+	}
+
+// Moves a split node's children between being evaluated and being drawn as
+// they are, and refreshes the colours of the ones drawn as they are
+void PersistentQuadtree::setQuadrants(int index, unsigned quadrants)
+	{
+	auto const children = _nodes[index].children;
+	auto const changed = quadrants ^ _nodes[index].quadrants;
+	_nodes[index].quadrants = uint8_t(quadrants);
+
+	for (int i = 0; i < 4; ++i)
+		{
+		auto const child = children + i;
+		if (!(quadrants & (1u << i)))
+			{
+			if (changed & (1u << i))
+				{
+				release(child);
+				unschedule(child);
+				++_nodes[child].stamp;
+				_nodes[child].pending = false;
+				}
+			showTile(child);
+			}
+		else if (changed & (1u << i))
+			{
+			// nodes at the deepest level are always drawn, see showTile
+			if (_nodes[child].depth == MAX_SUBDIVISION_DEPTH)
+				showTile(child);
+			else if (!_nodes[child].pending)
+				{
+				_nodes[child].pending = true;
+				_nextDue.push_back(child);
+				}
+			}
+		}
+	}
+
+// Sets the node's next recheck for once the camera has moved far enough
+// that its last result could be out of date. Per unit of camera travel the
+// direction to the node turns by at most 1/nearest (nearest being the
+// distance to its closest point) and the orbit camera's view direction by
+// 1/focusDistance, and the projected lengths change by about the same
+// ratios; that turns the margin to the threshold into a travel distance.
+// The sides of the view go through the camera and turn with the view, so a
+// point's distance to one changes by at most 1 + distance/focusDistance.
+void PersistentQuadtree::schedule(int index)
+	{
+	auto &node = _nodes[index];
+
+	auto lo = glm::min(node.p1, node.p2),
+		hi = glm::max(node.p1, node.p2);
+	auto closest = glm::vec3(glm::clamp(glm::vec2(_position), lo, hi), 0.f);
+	auto nearest = std::max(glm::distance(_position, closest), 1e-12f);
+
+	// how far the node's furthest corner inside each side is from it,
+	// negative when the whole node is outside
+	auto extent = (hi - lo) * 0.5f;
+	auto toCenter = glm::vec3((lo + hi) * 0.5f, 0.f) - _position;
+	float inside[4];
+	for (int i = 0; i < 4; ++i)
+		inside[i] = glm::dot(_sides[i], toCenter) + std::abs(_sides[i].x) * extent.x + std::abs(_sides[i].y) * extent.y;
+	auto sideRate = 1.f + (glm::length(toCenter) + glm::length(extent)) / _focusDistance;
+
+	float slack,
+		margin = 0.f;
+	if (node.visible)
+		{
+		// a split node changes its quadrants once any edge crosses the
+		// detail level, a leaf (every edge short) splits when one does
+		margin = 1.f;
+		for (auto length : node.lengths)
+			margin = std::min(margin, length > _detail ? 1.f - _detail / length : 1.f - length / _detail);
+		auto lengthSlack = std::max(margin, 0.f) / (1.f / nearest + 2.f / _focusDistance);
+
+		// culled once it's all past one side, or all beyond the far plane;
+		// that's 5x the orbit distance at most, so it closes in at up to 6x
+		// the camera travel
+		auto sideMargin = std::min(std::min(inside[0], inside[1]), std::min(inside[2], inside[3]));
+		auto sideSlack = std::max(sideMargin, 0.f) / sideRate;
+		auto farSlack = std::max(_farClip - nearest, 0.f) / 6.f;
+		slack = std::min(lengthSlack, std::min(sideSlack, farSlack));
+		}
+	else
+		{
+		// invisible until it's back inside every side and in front of the
+		// far plane
+		auto sideMargin = -std::min(std::min(inside[0], inside[1]), std::min(inside[2], inside[3]));
+		auto sideSlack = std::max(sideMargin, 0.f) / sideRate;
+		auto farSlack = std::max(nearest - _farClip, 0.f) / 6.f;
+		slack = std::max(sideSlack, farSlack);
+		}
+
+	++node.schedule;
+	_rechecks.push(_travel + RECHECK_SAFETY * slack, index, node.schedule);
+	compact(_rechecks);
+
+	// a visible node's lengths are margin (relative) from crossing, and
+	// travel uses up at most RECHECK_SAFETY of that before the recheck; a
+	// detail change of DETAIL_SHARE of it in log terms fits in the rest.
+	// Culled nodes don't depend on the detail level.
+	if (node.visible)
+		{
+		_detailRechecks.push(_detailTravel + DETAIL_SHARE * std::max(margin, 0.f), index, node.schedule);
+		compact(_detailRechecks);
+		}
+	}
+
+// Leaves the node's rechecks stale
+void PersistentQuadtree::unschedule(int index)
+	{
+	++_nodes[index].schedule;
+	}
+
+// Queues the nodes whose live recheck on this clock has come up, which
+// takes them out of both queues until they're rescheduled
+void PersistentQuadtree::dueBefore(DeadlineQueue &rechecks, double clock)
+	{
+	_taken.clear();
+	rechecks.takeBefore(clock, _taken);
+	for (auto &recheck : _taken)
+		{
+		auto &node = _nodes[recheck.node];
+		if (node.schedule != recheck.schedule)
+			continue;
+		++node.schedule;
+		if (!node.pending)
+			{
+			node.pending = true;
+			_due.push_back(recheck.node);
+			}
+		}
+	}
+
+// Stale entries only leave a queue once their deadline comes up; clears
+// them out before they outnumber the nodes
+void PersistentQuadtree::compact(DeadlineQueue &rechecks)
+	{
+	if (rechecks.size() > 2 * _nodes.size() + 64)
+		rechecks.filter([this](DeadlineQueue::Entry const &recheck) { return _nodes[recheck.node].schedule == recheck.schedule; });
+	}
+
+// Gives the leaf four children: the quadrants it refines are queued to be
+// evaluated, the others are drawn straight away
+void PersistentQuadtree::split(int index)
+	{
+	hideTile(index);
+
+	int children;
+	if (!_freeBlocks.empty())
+		{
+		children = _freeBlocks.back();
+		_freeBlocks.pop_back();
+		}
+	else
+		{
+		children = int(_nodes.size());
+		_nodes.resize(_nodes.size() + 4);
+		}
+
+	auto &node = _nodes[index];
+	node.children = children;
+
+	glm::vec2 const corners[] = { node.p1, glm::vec2(node.p2.x, node.p1.y), node.p2, glm::vec2(node.p1.x, node.p2.y) };
+	auto center = (node.p1 + node.p2) * 0.5f;
+	for (int i = 0; i < 4; ++i)
+		{
+		auto &child = _nodes[children + i];
+		child.p1 = corners[i];
+		child.p2 = center;
+		child.depth = node.depth + 1;
+		child.parent = index;
+		child.children = -1;
+		child.tile = -1;
+		child.quadrants = 0;
+		child.visible = false;
+		child.pending = false;
+		}
+
+	for (int i = 0; i < 4; ++i)
+		{
+		auto const child = children + i;
+		if (!(_nodes[index].quadrants & (1u << i)) || _nodes[child].depth == MAX_SUBDIVISION_DEPTH)
+			showTile(child);
+		else
+			{
+			_nodes[child].pending = true;
+			_nextDue.push_back(child);
+			}
+		}
+	}
+
+// Frees everything below the node, which becomes a leaf
+void PersistentQuadtree::release(int index)
+	{
+	auto const children = _nodes[index].children;
+	if (children < 0)
+		return;
+
+	for (int i = 0; i < 4; ++i)
+		{
+		auto const child = children + i;
+		release(child);
+		hideTile(child);
+		unschedule(child);
+		++_nodes[child].stamp;
+		_nodes[child].pending = false;
+		}
+
+	_freeBlocks.push_back(children);
+	_nodes[index].children = -1;
+	_nodes[index].quadrants = 0;
+	}
+
+// Adds the node's tile to the list, or refreshes its colour if it's there.
+// Quadrants the parent draws as they are take its colour for them, the
+// deepest level is drawn white like generateTiles does.
+void PersistentQuadtree::showTile(int index)
+	{
+	auto &node = _nodes[index];
+	glm::vec4 color;
+	if (!isEvaluated(index))
+		{
+		auto const &parent = _nodes[node.parent];
+		color = makeTileColor(float(parent.depth), parent.lengths[index - parent.children], _detail);
+		}
+	else if (node.depth == MAX_SUBDIVISION_DEPTH)
+		color = glm::vec4(1.f, 1.f, 1.f, 1.f);
+	else
+		{
+		auto minLength = std::min(std::min(node.lengths[0], node.lengths[1]), std::min(node.lengths[2], node.lengths[3]));
+		color = makeTileColor(float(node.depth), minLength, _detail);
+		}
+
+	if (node.tile >= 0)
+		{
+		(*_tiles)[node.tile].PackedColor = packTileColor(color);
+		return;
+		}
+
+	node.tile = int(_tiles->size());
+	_tiles->emplace_back(node.p1, node.p2, node.depth, color);
+	_tileNodes.push_back(index);
+	++_depthCounts[node.depth];
+	}
+
+// Removes the node's tile, moving the last tile into its slot
+void PersistentQuadtree::hideTile(int index)
+	{
+	auto &node = _nodes[index];
+	if (node.tile < 0)
+		return;
+
+	auto last = int(_tiles->size()) - 1;
+	(*_tiles)[node.tile] = (*_tiles)[last];
+	_tileNodes[node.tile] = _tileNodes[last];
+	_nodes[_tileNodes[node.tile]].tile = node.tile;
+	_tiles->pop_back();
+	_tileNodes.pop_back();
+
+	--_depthCounts[node.depth];
+	node.tile = -1;
+	}
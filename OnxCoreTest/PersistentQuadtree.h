@@ -0,0 +1,169 @@
+#pragma once
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include "TileBatch.h"
+#include "Types.h"
+
+// priority_queue that can be emptied without giving up its storage
+template <class T, class Compare = std::less<T>>
+class ReusableQueue : public std::priority_queue<T, std::vector<T>, Compare>
+	{
+public:
+	void clear() { this->c.clear(); }
+	};
+
+// Deadlines on a clock that only runs forwards. A radix heap: entries sit
+// in buckets by the highest bit their key differs from the clock's last
+// reading in, so adding one is a push_back, and taking out everything due
+// only looks at the buckets below the clock's and at most moves each entry
+// down a bucket or a few on the way. Deadlines must not be before the last
+// reading.
+class DeadlineQueue
+	{
+public:
+	struct Entry
+		{
+		uint64_t key;	// the deadline's bits, which order like it for positive doubles
+		int node;
+		unsigned schedule;
+		};
+
+	void clear();
+	size_t size() const { return _size; }
+	void push(double deadline, int node, unsigned schedule);
+	// Moves the entries before clock to taken, in no particular order
+	void takeBefore(double clock, std::vector<Entry> &taken);
+
+	// Drops the entries keep turns down
+	template <class Keep>
+	void filter(Keep keep)
+		{
+		_size = 0;
+		for (auto &bucket : _buckets)
+			{
+			bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [&keep](Entry const &entry) { return !keep(entry); }), bucket.end());
+			_size += bucket.size();
+			}
+		}
+
+private:
+	std::vector<Entry> _buckets[65];
+	std::vector<Entry> _kept;
+	uint64_t _last = 0;
+	size_t _size = 0;
+
+	int bucket(uint64_t key) const;
+	};
+
+// Quadtree that survives between frames. It makes the same decisions as
+// the rebuilding traversals, including their quadrant rule: a node with
+// edges over the detail level refines only the quadrants along them, the
+// others are drawn as they are without being evaluated. Each evaluated node
+// is looked at again only when the camera has travelled far enough, or the
+// detail level moved far enough, that its projected edge lengths (or
+// visibility) could have crossed the threshold; both deadlines are kept in
+// queues, so a frame only touches the nodes that came due. Leaves that need
+// refining go through a split queue and nodes that no longer need their
+// subtree through a merge queue, both ordered by screen space error (ROAM
+// style), and the tile list is patched in place as leaves come and go.
+//
+// The per frame work is the nodes whose deadline came up, which only pays
+// while the view changes slowly: an orbit at a steady distance re-evaluates
+// a fraction of the tiles a rebuild visits, but zooming moves every node's
+// margin at once and costs more than a rebuild. See OnxCoreBench
+// --work-report.
+//
+// The deadlines come from first order estimates of how fast a node's
+// projected lengths and sides move, and the lengths divide by w, which has
+// no useful bound near the camera plane; so an edge sitting within the
+// estimate's error of the threshold can cross it before its node is due,
+// and that node's tiles change a frame or so after a rebuild's would. The
+// work report counts the tiles the two disagree on. Tile colours are from
+// each node's last evaluation.
+class PersistentQuadtree
+{
+public:
+	void reset();
+	void update(CameraState const &camera, TileList &tiles);
+
+	int evaluated() const { return _evaluated; }
+	int splits() const { return _splits; }
+	int merges() const { return _merges; }
+	int maxDepth() const;
+
+private:
+	struct QuadNode
+		{
+		glm::vec2 p1;
+		glm::vec2 p2;
+		float lengths[4];	// projected edge lengths at the last evaluation
+		int depth;
+		int parent;
+		int children;	// first of four consecutive nodes, -1 for a leaf
+		int tile;		// slot in the tile list while drawn, -1 otherwise
+		unsigned schedule;	// bumped whenever its rechecks change, leaving the old ones stale
+		unsigned stamp;	// bumped when the node drops out of the tree or stops being evaluated
+		uint8_t quadrants;	// children that are evaluated themselves, one bit each
+		bool visible;
+		bool pending;	// waiting in the due list
+		};
+
+	struct Ranked
+		{
+		float error;
+		int node;
+		unsigned stamp;
+		bool operator<(Ranked const &other) const { return error < other.error; }
+		bool operator>(Ranked const &other) const { return error > other.error; }
+		};
+
+	std::vector<QuadNode> _nodes;
+	std::vector<int> _freeBlocks;
+	std::vector<int> _tileNodes;	// node owning each slot of the tile list
+	int _depthCounts[MAX_SUBDIVISION_DEPTH + 1] = {};
+
+	// every evaluated node's next recheck in camera travel, and for visible
+	// ones in detail travel as well; a rescheduled node's old entries stay
+	// behind and are skipped when they come out
+	DeadlineQueue _rechecks,
+		_detailRechecks;
+	std::vector<DeadlineQueue::Entry> _taken;
+
+	ReusableQueue<Ranked> _splitQueue;
+	ReusableQueue<Ranked, std::greater<Ranked>> _mergeQueue;
+
+	std::vector<int> _due, _nextDue;
+	NodeFrontier _dueFrontier;
+	NodeClassification _classified;
+
+	bool _valid = false;
+	float _detail = 0;
+	double _travel = 0,	// total camera movement, the clock rechecks run on
+		_detailTravel = 0;	// and total |log| of the detail level's changes
+
+	// this frame's camera, as schedule needs it
+	glm::vec3 _position;
+	glm::vec3 _sides[4];	// inward unit normals of the view's sides
+	float _focusDistance = 1,
+		_farClip = 0;
+
+	int _evaluated = 0,
+		_splits = 0,
+		_merges = 0;
+
+	TileList *_tiles = nullptr;
+
+	bool isLeaf(int node) const { return _nodes[node].children < 0; }
+	bool isEvaluated(int node) const;
+	void evaluateDue(CameraState const &camera);
+	void setQuadrants(int node, unsigned quadrants);
+	void schedule(int node);
+	void unschedule(int node);
+	void dueBefore(DeadlineQueue &rechecks, double clock);
+	void compact(DeadlineQueue &rechecks);
+	void split(int node);
+	void release(int node);
+	void showTile(int node);
+	void hideTile(int node);
+};
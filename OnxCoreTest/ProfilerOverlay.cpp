@@ -0,0 +1,146 @@
+#include "ProfilerOverlay.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include "OrbitCamera.h"
+
+namespace
+	{
+	constexpr float FONT_SCALE = 2.f,			// window pixels per font pixel
+		CHAR_ADVANCE = 4.f * FONT_SCALE,
+		LINE_HEIGHT = 7.f * FONT_SCALE,
+		MARGIN = 8.f,
+		BAR_LEFT = 30.f * CHAR_ADVANCE,
+		BAR_PIXELS_PER_MS = 20.f,				// a 60Hz frame is about 330 pixels
+		BAR_MAX_WIDTH = 400.f;
+
+	// Rows top to bottom, the 4 bit is the left column
+	char const FONT_CHARACTERS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/";
+	uint8_t const FONT_ROWS[][5] =
+		{
+		{7,5,5,5,7}, {2,6,2,2,7}, {7,1,7,4,7}, {7,1,3,1,7}, {5,5,7,1,1},
+		{7,4,7,1,7}, {7,4,7,5,7}, {7,1,1,2,2}, {7,5,7,5,7}, {7,5,7,1,7},
+		{2,5,7,5,5}, {6,5,6,5,6}, {3,4,4,4,3}, {6,5,5,5,6}, {7,4,6,4,7},
+		{7,4,6,4,4}, {3,4,5,5,3}, {5,5,7,5,5}, {7,2,2,2,7}, {1,1,1,5,2},
+		{5,5,6,5,5}, {4,4,4,4,7}, {5,7,7,5,5}, {6,5,5,5,5}, {2,5,5,5,2},
+		{6,5,6,4,4}, {2,5,5,6,3}, {6,5,6,5,5}, {3,4,2,1,6}, {7,2,2,2,2},
+		{5,5,5,5,7}, {5,5,5,5,2}, {5,5,7,7,5}, {5,5,2,5,5}, {5,5,2,2,2},
+		{7,1,2,4,7}, {0,0,0,0,2}, {0,2,0,2,0}, {0,0,7,0,0}, {1,1,2,4,4}
+		};
+
+	uint32_t const PANEL_COLOR = packTileColor(glm::vec4(0.f, 0.f, 0.f, 0.6f)),
+		TEXT_COLOR = packTileColor(glm::vec4(1.f, 1.f, 1.f, 1.f)),
+		CPU_COLOR = packTileColor(glm::vec4(1.f, 0.6f, 0.1f, 1.f)),
+		GPU_COLOR = packTileColor(glm::vec4(0.2f, 0.8f, 1.f, 1.f));
+	}
+
+// Takes ownership of shader, built from the overlay shaders
+ProfilerOverlay::ProfilerOverlay(GLuint shader) :
+	mShader(shader)
+{
+	if (mShader != (GLuint)-1)
+		mScreenSizeLoc = glGetUniformLocation(mShader, "ScreenSize");
+
+	glGenVertexArrays(1, &mVertexArray);
+	glBindVertexArray(mVertexArray);
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(OverlayVertex), (void*)offsetof(OverlayVertex, X));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(OverlayVertex), (void*)offsetof(OverlayVertex, PackedColor));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ProfilerOverlay::~ProfilerOverlay()
+{
+	glDeleteVertexArrays(1, &mVertexArray);
+	glDeleteBuffers(1, &mBuffer);
+	if (mShader != (GLuint)-1)
+		glDeleteProgram(mShader);
+}
+
+void ProfilerOverlay::addRect(float x, float y, float width, float height, uint32_t color)
+	{
+	OverlayVertex corners[4] =
+		{
+		{ x, y, color },
+		{ x + width, y, color },
+		{ x, y + height, color },
+		{ x + width, y + height, color }
+		};
+	for (int corner : { 0, 1, 2, 2, 1, 3 })
+		_vertices.push_back(corners[corner]);
+	}
+
+// Lower case comes out upper case, characters the font doesn't have as gaps
+void ProfilerOverlay::addText(float x, float y, char const *text, uint32_t color)
+	{
+	for (; *text; ++text, x += CHAR_ADVANCE)
+		{
+		auto found = strchr(FONT_CHARACTERS, toupper((unsigned char)*text));
+		if (!found || !*found)
+			continue;
+
+		auto &rows = FONT_ROWS[found - FONT_CHARACTERS];
+		for (int row = 0; row < 5; ++row)
+			for (int column = 0; column < 3; ++column)
+				if (rows[row] & (4 >> column))
+					addRect(x + column * FONT_SCALE, y + row * FONT_SCALE, FONT_SCALE, FONT_SCALE, color);
+		}
+	}
+
+void ProfilerOverlay::draw(FrameProfile const &profile, GLStateCache &state)
+	{
+	if (mShader == (GLuint)-1)
+		return;
+
+	_vertices.clear();
+	auto lines = 3 + FRAME_PHASE_COUNT;
+	addRect(MARGIN - 4.f, MARGIN - 4.f, BAR_LEFT + BAR_MAX_WIDTH, lines * LINE_HEIGHT + 4.f, PANEL_COLOR);
+
+	char line[128];
+	auto y = MARGIN;
+	snprintf(line, sizeof(line), "detail %.3f  depth %d  tiles %d  nodes %d", profile.detail, profile.maxDepth, profile.tiles, profile.nodesVisited);
+	addText(MARGIN, y, line, TEXT_COLOR);
+	y += LINE_HEIGHT;
+	addText(MARGIN, y, "phase       cpu us    gpu us", TEXT_COLOR);
+	y += LINE_HEIGHT;
+
+	for (int phase = 0; phase < FRAME_PHASE_COUNT; ++phase, y += LINE_HEIGHT)
+		{
+		auto cpu = profile.cpuMicroseconds[phase],
+			gpu = profile.gpuMicroseconds[phase];
+		if (FRAME_PHASE_GPU[phase])
+			snprintf(line, sizeof(line), "%-9s %8.1f  %8.1f", FRAME_PHASE_NAMES[phase], cpu, gpu);
+		else
+			snprintf(line, sizeof(line), "%-9s %8.1f         -", FRAME_PHASE_NAMES[phase], cpu);
+		addText(MARGIN, y, line, TEXT_COLOR);
+
+		auto barHeight = 2.f * FONT_SCALE;
+		addRect(BAR_LEFT, y, std::min(cpu * 0.001f * BAR_PIXELS_PER_MS, BAR_MAX_WIDTH), barHeight, CPU_COLOR);
+		if (FRAME_PHASE_GPU[phase])
+			addRect(BAR_LEFT, y + barHeight + 1.f, std::min(gpu * 0.001f * BAR_PIXELS_PER_MS, BAR_MAX_WIDTH), barHeight, GPU_COLOR);
+		}
+
+	// should read 0 once the tile lists have grown to fit
+	snprintf(line, sizeof(line), "allocations %d", profile.allocations);
+	addText(MARGIN, y, line, TEXT_COLOR);
+
+	state.enable(GL_DEPTH_TEST, false);
+	state.enable(GL_CULL_FACE, false);
+	state.enable(GL_BLEND, true);
+	state.polygonMode(GL_FILL);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	state.useProgram(mShader);
+	glUniform2f(mScreenSizeLoc, float(WINDOW_WIDTH), float(WINDOW_HEIGHT));
+	state.bindVertexArray(mVertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+	glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(OverlayVertex), _vertices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawArrays(GL_TRIANGLES, 0, GLsizei(_vertices.size()));
+
+	state.enable(GL_BLEND, false);
+	}
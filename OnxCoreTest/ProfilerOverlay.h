@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include "FrameProfiler.h"
+#include "GLPlatform.h"
+#include "GLStateCache.h"
+#include "Types.h"
+
+// A window pixel corner of an overlay triangle
+struct OverlayVertex
+	{
+	float X;
+	float Y;
+	uint32_t PackedColor;	// RGBA8, see packTileColor
+	};
+
+// Draws a FrameProfile over the top left of the frame: the numbers as text
+// in a built in 3x5 pixel font and a CPU and GPU bar per phase. Everything
+// is collected into one vertex list and drawn with a single call.
+class ProfilerOverlay
+{
+public:
+	explicit ProfilerOverlay(GLuint shader);
+	~ProfilerOverlay();
+
+	void draw(FrameProfile const &profile, GLStateCache &state);
+
+private:
+	GLuint mShader = (GLuint)-1;
+	GLint mScreenSizeLoc = -1;
+	GLuint mVertexArray = 0,
+		mBuffer = 0;
+	std::vector<OverlayVertex> _vertices;
+
+	void addRect(float x, float y, float width, float height, uint32_t color);
+	void addText(float x, float y, char const *text, uint32_t color);
+};
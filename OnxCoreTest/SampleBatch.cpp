@@ -0,0 +1,124 @@
+#include "SampleBatch.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SAMPLE_BATCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SAMPLE_BATCH_SSE2
+#endif
+
+// The same thin wrappers as TileBatch.cpp and NoiseBatch.cpp, with the 16
+// bit loads the conversion needs
+namespace
+	{
+#if defined(SAMPLE_BATCH_AVX2)
+	typedef __m256 lanes;
+	constexpr int LANES = 8;
+	constexpr char const *ISA = "AVX2";
+
+	inline lanes load(float const *p) { return _mm256_loadu_ps(p); }
+	inline lanes load(uint16_t const *p) { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(p)))); }
+	inline void store(float *p, lanes v) { _mm256_storeu_ps(p, v); }
+	inline lanes splat(float v) { return _mm256_set1_ps(v); }
+	inline lanes add(lanes a, lanes b) { return _mm256_add_ps(a, b); }
+	inline lanes mul(lanes a, lanes b) { return _mm256_mul_ps(a, b); }
+	inline lanes min(lanes a, lanes b) { return _mm256_min_ps(a, b); }
+	inline lanes max(lanes a, lanes b) { return _mm256_max_ps(a, b); }
+#elif defined(SAMPLE_BATCH_SSE2)
+	typedef __m128 lanes;
+	constexpr int LANES = 4;
+	constexpr char const *ISA = "SSE2";
+
+	inline lanes load(float const *p) { return _mm_loadu_ps(p); }
+	inline lanes load(uint16_t const *p)
+		{
+		auto raw = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(p));
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, _mm_setzero_si128()));
+		}
+	inline void store(float *p, lanes v) { _mm_storeu_ps(p, v); }
+	inline lanes splat(float v) { return _mm_set1_ps(v); }
+	inline lanes add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+	inline lanes mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+	inline lanes min(lanes a, lanes b) { return _mm_min_ps(a, b); }
+	inline lanes max(lanes a, lanes b) { return _mm_max_ps(a, b); }
+#else
+	typedef float lanes;
+	constexpr int LANES = 1;
+	constexpr char const *ISA = "scalar";
+
+	inline lanes load(float const *p) { return *p; }
+	inline lanes load(uint16_t const *p) { return float(*p); }
+	inline void store(float *p, lanes v) { *p = v; }
+	inline lanes splat(float v) { return v; }
+	inline lanes add(lanes a, lanes b) { return a + b; }
+	inline lanes mul(lanes a, lanes b) { return a * b; }
+	inline lanes min(lanes a, lanes b) { return a < b ? a : b; }
+	inline lanes max(lanes a, lanes b) { return a > b ? a : b; }
+#endif
+
+	// The lanes' scalar twins, for the samples left over after the batches
+	inline float convert(uint16_t value, float scale, float offset) { return float(value) * scale + offset; }
+	inline float tent(float a, float b, float c) { return ((a + (b + b)) + c) * 0.25f; }
+	}
+
+const int SAMPLE_LANES = LANES;
+const char* const SAMPLE_ISA = ISA;
+
+void convertBatch(uint16_t const *in, size_t count, float scale, float offset, float *out)
+	{
+	auto const s = splat(scale),
+		o = splat(offset);
+	size_t i = 0;
+	for (; i + LANES <= count; i += LANES)
+		store(out + i, add(mul(load(in + i), s), o));
+	for (; i < count; ++i)
+		out[i] = convert(in[i], scale, offset);
+	}
+
+glm::vec2 rangeBatch(float const *samples, size_t count)
+	{
+	auto lo = samples[0],
+		hi = samples[0];
+	size_t i = 0;
+	if (count >= size_t(LANES))
+		{
+		auto low = load(samples),
+			high = low;
+		for (i = LANES; i + LANES <= count; i += LANES)
+			{
+			auto v = load(samples + i);
+			low = min(v, low);
+			high = max(v, high);
+			}
+
+		float lows[LANES], highs[LANES];
+		store(lows, low);
+		store(highs, high);
+		for (int lane = 0; lane < LANES; ++lane)
+			{
+			lo = std::min(lo, lows[lane]);
+			hi = std::max(hi, highs[lane]);
+			}
+		}
+	for (; i < count; ++i)
+		{
+		lo = std::min(lo, samples[i]);
+		hi = std::max(hi, samples[i]);
+		}
+	return glm::vec2(lo, hi);
+	}
+
+void tentBatch(float const *a, float const *b, float const *c, size_t count, float *out)
+	{
+	auto const quarter = splat(0.25f);
+	size_t i = 0;
+	for (; i + LANES <= count; i += LANES)
+		{
+		auto middle = load(b + i);
+		store(out + i, mul(add(add(load(a + i), add(middle, middle)), load(c + i)), quarter));
+		}
+	for (; i < count; ++i)
+		out[i] = tent(a[i], b[i], c[i]);
+	}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm.hpp>
+
+// Height sample kernels for building tile pyramids, SAMPLE_LANES samples per
+// instruction. Each lane does the scalar loop's float operations in the
+// same order, so the instruction set doesn't change a pyramid unless the
+// compiler fuses multiplies and adds, as NoiseBatch.h describes.
+
+// out[i] = in[i] * scale + offset, raw 16 bit samples to elevations
+void convertBatch(uint16_t const *in, size_t count, float scale, float offset, float *out);
+// Smallest and largest of count >= 1 samples
+glm::vec2 rangeBatch(float const *samples, size_t count);
+// out[i] = (a[i] + 2 * b[i] + c[i]) / 4, the 1 2 1 tent that averages a
+// grid down to every other sample; across rows with a, b and c the rows
+// around one, along a row with them one sample apart
+void tentBatch(float const *a, float const *b, float const *c, size_t count, float *out);
+
+extern const int SAMPLE_LANES;
+extern const char* const SAMPLE_ISA;
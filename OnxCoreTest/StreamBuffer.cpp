@@ -0,0 +1,129 @@
+#include "StreamBuffer.h"
+#include <algorithm>
+#include <chrono>
+
+// Smallest region allocated, in elements, so the first few frames don't
+// each grow the buffer
+constexpr size_t MIN_REGION_CAPACITY = 4096;
+
+StreamBuffer::StreamBuffer(size_t stride) :
+	  _stride(stride)
+{
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	release();
+}
+
+void StreamBuffer::release()
+	{
+	for (auto &fence : _fences)
+		{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+		}
+
+	if (_buffer)
+		{
+		if (_mapped)
+			{
+			glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			}
+		glDeleteBuffers(1, &_buffer);
+		}
+	_buffer = 0;
+	_mapped = nullptr;
+	}
+
+// Makes sure a region holds count elements; returns true when that meant
+// creating a new buffer, whose name the caller has to rebind
+bool StreamBuffer::reserve(size_t count)
+	{
+	if (_buffer && count <= _regionCapacity)
+		return false;
+
+	// The old regions may still be in flight
+	if (_buffer)
+		glFinish();
+	release();
+
+	_regionCapacity = std::max({ count + count / 2, _regionCapacity * 2, MIN_REGION_CAPACITY });
+	_region = REGIONS - 1;
+	auto bytes = GLsizeiptr(_regionCapacity * _stride * REGIONS);
+
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	_persistent = hasGLExtension("GL_ARB_buffer_storage");
+	if (_persistent)
+		{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+		_mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+		}
+	else
+		glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	++_stats.reallocations;
+	return true;
+	}
+
+// Moves on to the next region and returns where to write count elements;
+// reserve(count) first
+void *StreamBuffer::map(size_t count)
+	{
+	_region = (_region + 1) % REGIONS;
+	_stats.bytesStreamed = count * _stride;
+	_stats.fenceWaitMicroseconds = waitForRegion(_region);
+
+	if (_persistent)
+		return _mapped + offset();
+
+	glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	auto mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset(), count * _stride,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return mapped;
+	}
+
+// Done writing, call before drawing from the region
+void StreamBuffer::unmap()
+	{
+	if (_persistent)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+// Call after the draws reading the region have been issued
+void StreamBuffer::fence()
+	{
+	_fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+// Blocks until the GPU is done with the region, returns how long that took
+float StreamBuffer::waitForRegion(int region)
+	{
+	auto &fence = _fences[region];
+	if (!fence)
+		return 0;
+
+	auto start = std::chrono::steady_clock::now();
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	for (;;)
+		{
+		auto result = glClientWaitSync(fence, flags, 1000000);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+			break;
+		flags = 0;
+		}
+	glDeleteSync(fence);
+	fence = nullptr;
+	return std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include "GLPlatform.h"
+
+// What the last map() cost
+struct StreamStats
+	{
+	float fenceWaitMicroseconds;	// blocked waiting for the GPU to finish with the region
+	size_t bytesStreamed;
+	int reallocations;				// times the buffer has grown
+	};
+
+// Streams per frame vertex data through a ring of REGIONS regions in one
+// persistently mapped buffer (ARB_buffer_storage). Each frame writes the
+// next region in place; a fence after the draw keeps the CPU from writing
+// a region again until the GPU has read it. Without buffer storage each
+// map maps just the region of a plain buffer, unsynchronized and with the
+// range invalidated, relying on the same fences.
+//
+// Sizes are in elements of the stride given to the constructor.
+class StreamBuffer
+{
+public:
+	static constexpr int REGIONS = 3;
+
+	explicit StreamBuffer(size_t stride);
+	~StreamBuffer();
+
+	bool reserve(size_t count);
+	void *map(size_t count);
+	void unmap();
+	void fence();
+
+	GLuint buffer() const { return _buffer; }
+	size_t offset() const { return _region * _regionCapacity * _stride; }	// of the mapped region, bytes
+	StreamStats const &stats() const { return _stats; }
+
+private:
+	size_t _stride;
+	size_t _regionCapacity = 0;	// elements
+	bool _persistent = false;
+	GLuint _buffer = 0;
+	char *_mapped = nullptr;
+	int _region = REGIONS - 1;
+	GLsync _fences[REGIONS] = {};
+	StreamStats _stats = {};
+
+	void release();
+	float waitForRegion(int region);
+};
@@ -0,0 +1,134 @@
+#include "TaskPool.h"
+#include <algorithm>
+#include <string>
+#include "TraceRecorder.h"
+
+TaskPool::TaskPool(int threadCount) :
+	  _pending(0)
+{
+	threadCount = std::max(threadCount, 1);
+	for (int i = 0; i < threadCount; ++i)
+		_workers.emplace_back(new Worker());
+
+	// worker 0 is whoever calls run()
+	for (int i = 1; i < threadCount; ++i)
+		_threads.emplace_back(&TaskPool::workerLoop, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+	{
+	std::lock_guard<std::mutex> lock(_wakeLock);
+	_quit = true;
+	}
+	_wake.notify_all();
+
+	for (auto &thread : _threads)
+		thread.join();
+}
+
+// Queue a task, spreading them round robin so the workers start out with
+// roughly even queues and only steal to balance out the uneven subtrees
+void TaskPool::push(Task task)
+	{
+	auto &worker = *_workers[_nextQueue];
+	_nextQueue = (_nextQueue + 1) % size();
+
+	_pending.fetch_add(1, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(worker.lock);
+	worker.queue.push_back(std::move(task));
+	}
+
+// Wake the workers and help out until every queued task has finished
+void TaskPool::run()
+	{
+	if (_pending.load(std::memory_order_acquire) == 0)
+		return;
+
+	{
+	std::lock_guard<std::mutex> lock(_wakeLock);
+	++_epoch;
+	_traceCameraFrame = TraceRecorder::threadCameraFrame();
+	}
+	_wake.notify_all();
+
+	drain(0);
+	_nextQueue = 0;
+	}
+
+void TaskPool::workerLoop(int index)
+	{
+	TraceRecorder::setThreadName("worker " + std::to_string(index));
+
+	unsigned seen = 0;
+	for (;;)
+		{
+		{
+		std::unique_lock<std::mutex> lock(_wakeLock);
+		_wake.wait(lock, [&] { return _quit || _epoch != seen; });
+		if (_quit)
+			return;
+		seen = _epoch;
+		// the tasks work on whichever camera the thread calling run() was
+		TraceRecorder::setThreadCameraFrame(_traceCameraFrame);
+		}
+
+		drain(index);
+		}
+	}
+
+// _pending only drops once a task has completed, so when it reads zero all
+// of the results are visible to the caller
+void TaskPool::drain(int index)
+	{
+	Task task;
+	while (_pending.load(std::memory_order_acquire) > 0)
+		{
+		if (pop(index, task) || steal(index, task))
+			{
+			TraceScope scope("task", "worker");
+			task(index);
+			task = nullptr;
+			_pending.fetch_sub(1, std::memory_order_acq_rel);
+			}
+		else
+			std::this_thread::yield();
+		}
+	}
+
+bool TaskPool::pop(int index, Task &task)
+	{
+	auto &worker = *_workers[index];
+	std::lock_guard<std::mutex> lock(worker.lock);
+	if (worker.empty())
+		return false;
+
+	task = std::move(worker.queue.back());
+	worker.queue.pop_back();
+	if (worker.empty())
+		{
+		worker.queue.clear();
+		worker.front = 0;
+		}
+	return true;
+	}
+
+bool TaskPool::steal(int index, Task &task)
+	{
+	for (int i = 1; i < size(); ++i)
+		{
+		auto &victim = *_workers[(index + i) % size()];
+		std::lock_guard<std::mutex> lock(victim.lock);
+		if (victim.empty())
+			continue;
+
+		task = std::move(victim.queue[victim.front++]);
+		if (victim.empty())
+			{
+			victim.queue.clear();
+			victim.front = 0;
+			}
+		return true;
+		}
+	return false;
+	}
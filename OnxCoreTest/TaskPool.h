@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool: every worker owns a queue, pops its own work
+// from the back and steals from the front of the others when it runs dry.
+// The thread calling run() takes part as worker 0, so a pool of size 1
+// runs everything inline with no extra threads.
+class TaskPool
+{
+public:
+	typedef std::function<void(int worker)> Task;
+
+	explicit TaskPool(int threadCount);
+	~TaskPool();
+
+	int size() const { return int(_workers.size()); }
+
+	void push(Task task);
+	void run();
+
+private:
+	struct Worker
+		{
+		std::mutex lock;
+		std::vector<Task> queue;	// a vector rather than a deque so it keeps its storage
+		size_t front = 0;			// tasks before this have been stolen
+
+		bool empty() const { return front == queue.size(); }
+		};
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::vector<std::thread> _threads;
+	std::atomic<int> _pending;
+	int _nextQueue = 0;
+
+	std::mutex _wakeLock;
+	std::condition_variable _wake;
+	unsigned _epoch = 0;
+	int _traceCameraFrame = -1;	// the run() caller's, see TraceRecorder::setThreadCameraFrame
+	bool _quit = false;
+
+	void workerLoop(int index);
+	void drain(int index);
+	bool pop(int index, Task &task);
+	bool steal(int index, Task &task);
+};
@@ -0,0 +1,227 @@
+#include "TileBatch.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TILE_BATCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TILE_BATCH_SSE2
+#else
+#include <cmath>
+#endif
+
+// Thin wrappers so the kernel below reads the same for every instruction set.
+// Comparisons are the ordered ones the scalar code gets from <, >= and <=,
+// except nle which is true for NaN just like !(a <= b).
+namespace
+	{
+#if defined(TILE_BATCH_AVX2)
+	typedef __m256 lanes;
+	typedef __m256 mask;
+	constexpr int LANES = 8;
+	constexpr char const *ISA = "AVX2";
+
+	inline lanes load(float const *p) { return _mm256_loadu_ps(p); }
+	inline void store(float *p, lanes v) { _mm256_storeu_ps(p, v); }
+	inline lanes splat(float v) { return _mm256_set1_ps(v); }
+	inline lanes add(lanes a, lanes b) { return _mm256_add_ps(a, b); }
+	inline lanes sub(lanes a, lanes b) { return _mm256_sub_ps(a, b); }
+	inline lanes mul(lanes a, lanes b) { return _mm256_mul_ps(a, b); }
+	inline lanes div(lanes a, lanes b) { return _mm256_div_ps(a, b); }
+	inline lanes sqrt(lanes a) { return _mm256_sqrt_ps(a); }
+	inline lanes abs(lanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+	inline mask lt(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline mask le(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	inline mask ge(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	inline mask nle(lanes a, lanes b) { return _mm256_cmp_ps(a, b, _CMP_NLE_UQ); }
+	inline mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+	inline mask either(mask a, mask b) { return _mm256_or_ps(a, b); }
+	inline int bits(mask m) { return _mm256_movemask_ps(m); }
+#elif defined(TILE_BATCH_SSE2)
+	typedef __m128 lanes;
+	typedef __m128 mask;
+	constexpr int LANES = 4;
+	constexpr char const *ISA = "SSE2";
+
+	inline lanes load(float const *p) { return _mm_loadu_ps(p); }
+	inline void store(float *p, lanes v) { _mm_storeu_ps(p, v); }
+	inline lanes splat(float v) { return _mm_set1_ps(v); }
+	inline lanes add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+	inline lanes sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+	inline lanes mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+	inline lanes div(lanes a, lanes b) { return _mm_div_ps(a, b); }
+	inline lanes sqrt(lanes a) { return _mm_sqrt_ps(a); }
+	inline lanes abs(lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+	inline mask lt(lanes a, lanes b) { return _mm_cmplt_ps(a, b); }
+	inline mask le(lanes a, lanes b) { return _mm_cmple_ps(a, b); }
+	inline mask ge(lanes a, lanes b) { return _mm_cmpge_ps(a, b); }
+	inline mask nle(lanes a, lanes b) { return _mm_cmpnle_ps(a, b); }
+	inline mask both(mask a, mask b) { return _mm_and_ps(a, b); }
+	inline mask either(mask a, mask b) { return _mm_or_ps(a, b); }
+	inline int bits(mask m) { return _mm_movemask_ps(m); }
+#else
+	typedef float lanes;
+	typedef bool mask;
+	constexpr int LANES = 1;
+	constexpr char const *ISA = "scalar";
+
+	inline lanes load(float const *p) { return *p; }
+	inline void store(float *p, lanes v) { *p = v; }
+	inline lanes splat(float v) { return v; }
+	inline lanes add(lanes a, lanes b) { return a + b; }
+	inline lanes sub(lanes a, lanes b) { return a - b; }
+	inline lanes mul(lanes a, lanes b) { return a * b; }
+	inline lanes div(lanes a, lanes b) { return a / b; }
+	inline lanes sqrt(lanes a) { return std::sqrt(a); }
+	inline lanes abs(lanes a) { return std::abs(a); }
+	inline mask lt(lanes a, lanes b) { return a < b; }
+	inline mask le(lanes a, lanes b) { return a <= b; }
+	inline mask ge(lanes a, lanes b) { return a >= b; }
+	inline mask nle(lanes a, lanes b) { return !(a <= b); }
+	inline mask both(mask a, mask b) { return a && b; }
+	inline mask either(mask a, mask b) { return a || b; }
+	inline int bits(mask m) { return m ? 1 : 0; }
+#endif
+
+	// The columns of the view projection that matter for points on z=0,
+	// clip = col0 * x + col1 * y + col3
+	struct Projection
+		{
+		lanes col0[4], col1[4], col3[4];
+
+		explicit Projection(glm::mat4x4 const &m)
+			{
+			for (int k = 0; k < 4; ++k)
+				{
+				col0[k] = splat(m[0][k]);
+				col1[k] = splat(m[1][k]);
+				col3[k] = splat(m[3][k]);
+				}
+			}
+		};
+
+	// Classifies LANES nodes, the same tests generateTiles does one node at a time
+	inline void classifyGroup(float const *x1, float const *y1, float const *x2, float const *y2,
+		Projection const &proj, lanes const detail, float *const length[4], uint8_t *culled, uint8_t *refine)
+		{
+		lanes const xs[] = { load(x1), load(x2) };
+		lanes const ys[] = { load(y1), load(y2) };
+		static int const cornerX[] = { 0, 1, 1, 0 };	//		0		1
+		static int const cornerY[] = { 0, 0, 1, 1 };	//	 P1	+-------+
+														//		|		|
+		lanes const zero = splat(0.f),					//		+-------+ P2
+			one = splat(1.f),							//		3		2
+			minusOne = splat(-1.f);
+
+		lanes sx[4], sy[4];
+		mask allBehind, farZ, zeroW, right, left, top, bottom;
+		for (int c = 0; c < 4; ++c)
+			{
+			auto xPart = xs[cornerX[c]],
+				yPart = ys[cornerY[c]];
+
+			lanes clip[4];
+			for (int k = 0; k < 4; ++k)
+				clip[k] = add(add(mul(proj.col0[k], xPart), mul(proj.col1[k], yPart)), proj.col3[k]);
+
+			auto behind = lt(clip[3], zero);
+			auto w = abs(clip[3]);
+			auto invW = div(one, w);
+			sx[c] = mul(clip[0], invW);
+			sy[c] = mul(clip[1], invW);
+			auto sz = mul(clip[2], invW);
+
+			if (c == 0)
+				{
+				allBehind = behind;
+				farZ = ge(sz, one);
+				zeroW = le(w, zero);
+				right = ge(sx[c], one);
+				left = le(sx[c], minusOne);
+				top = ge(sy[c], one);
+				bottom = le(sy[c], minusOne);
+				}
+			else
+				{
+				allBehind = both(allBehind, behind);
+				farZ = both(farZ, ge(sz, one));
+				zeroW = both(zeroW, le(w, zero));
+				right = both(right, ge(sx[c], one));
+				left = both(left, le(sx[c], minusOne));
+				top = both(top, ge(sy[c], one));
+				bottom = both(bottom, le(sy[c], minusOne));
+				}
+			}
+
+		auto outside = either(either(either(allBehind, farZ), either(zeroW, right)), either(either(left, top), bottom));
+		int const culledBits = bits(outside);
+
+		int refineBits[4];
+		for (int e = 0; e < 4; ++e)
+			{
+			auto dx = sub(sx[e], sx[(e + 1) & 3]),
+				dy = sub(sy[e], sy[(e + 1) & 3]);
+			auto len = sqrt(add(mul(dx, dx), mul(dy, dy)));
+			store(length[e], len);
+			refineBits[e] = bits(nle(len, detail));
+			}
+
+		for (int l = 0; l < LANES; ++l)
+			{
+			culled[l] = uint8_t((culledBits >> l) & 1);
+			refine[l] = uint8_t(((refineBits[0] >> l) & 1) |
+				(((refineBits[1] >> l) & 1) << 1) |
+				(((refineBits[2] >> l) & 1) << 2) |
+				(((refineBits[3] >> l) & 1) << 3));
+			}
+		}
+	}
+
+const int BATCH_LANES = LANES;
+const char* const BATCH_ISA = ISA;
+
+void classifyNodes(NodeFrontier const &nodes, glm::mat4x4 const &viewProj, float detail, NodeClassification &out)
+	{
+	size_t const count = nodes.size();
+	for (auto &length : out.length)
+		length.resize(count);
+	out.culled.resize(count);
+	out.refine.resize(count);
+
+	Projection const proj(viewProj);
+	lanes const limit = splat(detail);
+
+	size_t i = 0;
+	for (; i + LANES <= count; i += LANES)
+		{
+		float *const length[] = { &out.length[0][i], &out.length[1][i], &out.length[2][i], &out.length[3][i] };
+		classifyGroup(&nodes.x1[i], &nodes.y1[i], &nodes.x2[i], &nodes.y2[i], proj, limit, length, &out.culled[i], &out.refine[i]);
+		}
+
+	if (i == count)
+		return;
+
+	// the last partial batch is padded with copies of the final node
+	float x1[LANES], y1[LANES], x2[LANES], y2[LANES], lengths[4][LANES];
+	uint8_t culled[LANES], refine[LANES];
+	for (int l = 0; l < LANES; ++l)
+		{
+		auto node = std::min(i + size_t(l), count - 1);
+		x1[l] = nodes.x1[node];
+		y1[l] = nodes.y1[node];
+		x2[l] = nodes.x2[node];
+		y2[l] = nodes.y2[node];
+		}
+
+	float *const length[] = { lengths[0], lengths[1], lengths[2], lengths[3] };
+	classifyGroup(x1, y1, x2, y2, proj, limit, length, culled, refine);
+
+	for (size_t l = 0; i + l < count; ++l)
+		{
+		for (int e = 0; e < 4; ++e)
+			out.length[e][i + l] = lengths[e][l];
+		out.culled[i + l] = culled[l];
+		out.refine[i + l] = refine[l];
+		}
+	}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm.hpp>
+
+// One level of the quadtree in structure-of-arrays form, all the nodes
+// share a depth so only the world space corners are stored
+struct NodeFrontier
+	{
+	std::vector<float> x1, y1, x2, y2;
+
+	size_t size() const { return x1.size(); }
+	size_t capacity() const { return x1.capacity(); }
+
+	void reserve(size_t count)
+		{
+		x1.reserve(count);
+		y1.reserve(count);
+		x2.reserve(count);
+		y2.reserve(count);
+		}
+
+	void clear()
+		{
+		x1.clear();
+		y1.clear();
+		x2.clear();
+		y2.clear();
+		}
+
+	void push(glm::vec2 const &p1, glm::vec2 const &p2)
+		{
+		x1.push_back(p1.x);
+		y1.push_back(p1.y);
+		x2.push_back(p2.x);
+		y2.push_back(p2.y);
+		}
+	};
+
+// Per node results of classifyNodes; lengths are the projected edge lengths
+// in the same 0-3 order generateTiles uses, refine holds one bit per edge
+// that is longer than the detail level
+struct NodeClassification
+	{
+	std::vector<float> length[4];
+	std::vector<uint8_t> culled;
+	std::vector<uint8_t> refine;
+	};
+
+// Runs the behind camera test, perspective divide, clip tests and edge
+// length/detail comparison for every node of a frontier, BATCH_LANES nodes
+// at a time.
+void classifyNodes(NodeFrontier const &nodes, glm::mat4x4 const &viewProj, float detail, NodeClassification &out);
+
+extern const int BATCH_LANES;
+extern const char* const BATCH_ISA;
@@ -0,0 +1,1073 @@
+#include "TileGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include "TraceRecorder.h"
+
+// A drawn terrain tile whose longest edge is past this fraction of the
+// detail level is close enough to splitting that its children are prefetched
+constexpr float PREFETCH_DETAIL_FRACTION = 0.5f;
+
+TileGenerator::TileGenerator()
+	{
+	setTraversalThreads(int(std::thread::hardware_concurrency()));
+	}
+
+TileGenerator::~TileGenerator()
+	{
+	setAsyncGeneration(false);
+	}
+
+// Extracts the frustum planes from a view projection matrix, normals facing
+// inwards, in the bit order used by the plane masks: left, right, bottom,
+// top, near, far. perspective() maps depth to [0, 1] so the near plane is
+// the z row on its own.
+void extractFrustumPlanes(glm::mat4x4 const &m, glm::vec4 (&planes)[6])
+	{
+	auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+
+	planes[0] = row(3) + row(0);
+	planes[1] = row(3) - row(0);
+	planes[2] = row(3) + row(1);
+	planes[3] = row(3) - row(1);
+	planes[4] = row(2);
+	planes[5] = row(3) - row(2);
+	}
+
+// Tests the quad against the frustum planes not already in planesInside,
+// returns false if it's entirely outside one of them and adds the planes
+// it's entirely inside of to the mask. The quad is an axis aligned
+// rectangle on z=0 so only the two corners furthest along and against each
+// plane normal need checking.
+bool TileGenerator::cullAgainstPlanes(glm::vec2 const p1, glm::vec2 const p2, unsigned &planesInside) const
+	{
+	auto lo = glm::min(p1, p2),
+		hi = glm::max(p1, p2);
+
+	for (int i = 0; i < 6; ++i)
+		{
+		if (planesInside & (1 << i))
+			continue;
+
+		auto const &plane = _frustumPlanes[i];
+		auto maxDist = plane.x * (plane.x > 0 ? hi.x : lo.x) + plane.y * (plane.y > 0 ? hi.y : lo.y) + plane.w;
+		if (maxDist < 0)
+			return false;
+
+		auto minDist = plane.x * (plane.x > 0 ? lo.x : hi.x) + plane.y * (plane.y > 0 ? lo.y : hi.y) + plane.w;
+		if (minDist >= 0)
+			planesInside |= 1 << i;
+		}
+	return true;
+	}
+
+// cullAgainstPlanes for the quad raised into a box over its elevation
+// range; the z term picks the top or bottom of the box the same way
+bool TileGenerator::cullBoxAgainstPlanes(glm::vec2 const p1, glm::vec2 const p2, glm::vec2 const range, unsigned &planesInside) const
+	{
+	auto lo = glm::min(p1, p2),
+		hi = glm::max(p1, p2);
+
+	for (int i = 0; i < 6; ++i)
+		{
+		if (planesInside & (1 << i))
+			continue;
+
+		auto const &plane = _frustumPlanes[i];
+		auto maxDist = plane.x * (plane.x > 0 ? hi.x : lo.x) + plane.y * (plane.y > 0 ? hi.y : lo.y) + plane.z * (plane.z > 0 ? range.y : range.x) + plane.w;
+		if (maxDist < 0)
+			return false;
+
+		auto minDist = plane.x * (plane.x > 0 ? lo.x : hi.x) + plane.y * (plane.y > 0 ? lo.y : hi.y) + plane.z * (plane.z > 0 ? range.x : range.y) + plane.w;
+		if (minDist >= 0)
+			planesInside |= 1 << i;
+		}
+	return true;
+	}
+
+// Divides a quad's clip space corners by w and measures its projected
+// edges, lengths[i] being the edge from corner i to corner i + 1. Returns
+// false if the quad is entirely behind the camera or outside the clip
+// space cube; with clipTests false (the frustum planes have already been
+// checked) only the lengths are computed.
+// generateTiles has these tests and splitClipCorners below written out in
+// place; calling these from it instead measured 7-10% slower.
+bool measureQuad(glm::vec4 const (&clip)[4], bool clipTests, float (&lengths)[4])
+	{
+	glm::vec4 projected[] = { clip[0], clip[1], clip[2], clip[3] };
+
+	int behindCount = 0;
+	for (int i = 0; i < 4; ++i)
+		if (projected[i].w < 0)
+			{
+			++behindCount;
+			projected[i].w = std::abs(projected[i].w);
+			}
+
+	if (behindCount == 4 && clipTests)
+		return false;
+
+	glm::vec3 screenCorners[] =
+		{
+		glm::vec3(projected[0].x, projected[0].y, projected[0].z) / projected[0].w,
+		glm::vec3(projected[1].x, projected[1].y, projected[1].z) / projected[1].w,
+		glm::vec3(projected[2].x, projected[2].y, projected[2].z) / projected[2].w,
+		glm::vec3(projected[3].x, projected[3].y, projected[3].z) / projected[3].w,
+		};
+
+	if (clipTests &&
+		((screenCorners[0].z >= 1 &&
+		screenCorners[1].z >= 1 &&
+		screenCorners[2].z >= 1 &&
+		screenCorners[3].z >= 1) ||
+		(projected[0].w <= 0.0f &&
+			projected[1].w <= 0.0f &&
+			projected[2].w <= 0.0f &&
+			projected[3].w <= 0.0f)))
+		return false; // It's outside of Z clip space
+
+	for (int dim = 0; dim <= 1 && clipTests; ++dim)
+		if ((screenCorners[0][dim] >= 1.f &&
+				screenCorners[1][dim] >= 1.f &&
+				screenCorners[2][dim] >= 1.f &&
+				screenCorners[3][dim] >= 1.f)
+			|| (screenCorners[0][dim] <= -1.f &&
+				screenCorners[1][dim] <= -1.f &&
+				screenCorners[2][dim] <= -1.f &&
+				screenCorners[3][dim] <= -1.f))
+			{
+			return false; // It's outside of X or Y clip space
+			}
+
+	glm::vec2 edges[] =
+		{
+		screenCorners[0] - screenCorners[1],
+		screenCorners[1] - screenCorners[2],
+		screenCorners[2] - screenCorners[3],
+		screenCorners[3] - screenCorners[0]
+		};
+
+	for (int i = 0; i < 4; ++i)
+		lengths[i] = glm::length(edges[i]);
+	return true;
+	}
+
+// measureQuad for a quad raised into a box over its elevation range. The
+// box's corners are the flat corners plus z times zAxis, the view
+// projection's z column, so nothing is projected again. The clip tests are
+// done before the divide: the box is culled if all eight corners are
+// outside the same clip plane. Each edge's length is the longer of the
+// box's top and bottom faces, so a tall node on a slope facing the camera
+// still refines.
+bool measureBox(glm::vec4 const (&clip)[4], glm::vec4 const &zAxis, glm::vec2 const &range, bool clipTests, float (&lengths)[4])
+	{
+	glm::vec4 corners[8];
+	for (int i = 0; i < 4; ++i)
+		{
+		corners[i] = clip[i] + zAxis * range.x;
+		corners[i + 4] = clip[i] + zAxis * range.y;
+		}
+
+	if (clipTests)
+		{
+		unsigned outside = 0x3f;	// planes every corner so far is outside of
+		for (auto const &corner : corners)
+			outside &= unsigned(corner.x < -corner.w) |
+				unsigned(corner.x > corner.w) << 1 |
+				unsigned(corner.y < -corner.w) << 2 |
+				unsigned(corner.y > corner.w) << 3 |
+				unsigned(corner.z < 0.f) << 4 |
+				unsigned(corner.z > corner.w) << 5;
+		if (outside)
+			return false;
+		}
+
+	// behind the camera corners are mirrored the same way generateTiles does
+	glm::vec2 screenCorners[8];
+	for (int i = 0; i < 8; ++i)
+		screenCorners[i] = glm::vec2(corners[i]) / std::max(std::abs(corners[i].w), 1e-6f);
+
+	for (int i = 0; i < 4; ++i)
+		{
+		auto next = (i + 1) & 3;
+		lengths[i] = std::max(glm::length(screenCorners[i] - screenCorners[next]), glm::length(screenCorners[i + 4] - screenCorners[next + 4]));
+		}
+	return true;
+	}
+
+// Clip space corners of the quad p1, p2 on z=0, in the order generateTiles
+// numbers them
+void projectQuad(glm::mat4x4 const &viewProj, glm::vec2 const p1, glm::vec2 const p2, glm::vec4 (&clip)[4])
+	{
+	clip[0] = viewProj * glm::vec4(p1.x, p1.y, 0, 1);
+	clip[1] = viewProj * glm::vec4(p2.x, p1.y, 0, 1);
+	clip[2] = viewProj * glm::vec4(p2.x, p2.y, 0, 1);
+	clip[3] = viewProj * glm::vec4(p1.x, p2.y, 0, 1);
+	}
+
+// Clip space corners of the four quadrants, by averaging the same way
+// generateTiles does. Quadrant i spans corner i to the center, its corners
+// in the same order.
+void splitClipCorners(glm::vec4 const (&clip)[4], glm::vec4 (&children)[4][4])
+	{
+	glm::vec4 const edgeMids[] =
+		{									//			0
+		(clip[0] + clip[1]) * 0.5f,			//	 	+---+---+
+		(clip[1] + clip[2]) * 0.5f,			//	  3 |	c	| 1
+		(clip[2] + clip[3]) * 0.5f,			//		+---+---+
+		(clip[3] + clip[0]) * 0.5f			//			2
+		};
+	auto clipCenter = (clip[0] + clip[2]) * 0.5f;
+
+	children[0][0] = clip[0];	children[0][1] = edgeMids[0];	children[0][2] = clipCenter;	children[0][3] = edgeMids[3];
+	children[1][0] = clip[1];	children[1][1] = edgeMids[0];	children[1][2] = clipCenter;	children[1][3] = edgeMids[1];
+	children[2][0] = clip[2];	children[2][1] = edgeMids[2];	children[2][2] = clipCenter;	children[2][3] = edgeMids[1];
+	children[3][0] = clip[3];	children[3][1] = edgeMids[2];	children[3][2] = clipCenter;	children[3][3] = edgeMids[3];
+	}
+
+// Recursively subdivides a quad, culling the output using _frameCamera;
+// results are appended to the sink's tiles.
+// clip holds the quad's corners already multiplied by its ViewProj, the
+// children get theirs by averaging, see below. With CullMode::FrustumPlanes
+// the clip space tests are replaced by cullAgainstPlanes, and planesInside
+// carries the planes the parent was already entirely inside of.
+// CullMode::ClipSpace lets some tiles behind the camera through when the
+// detail level is very low: a corner behind the camera has a negative w, and
+// dividing by it (even after taking |w|) mirrors the corner through the eye,
+// so a quad straddling the camera plane can land inside the NDC tests.
+// CullMode::FrustumPlanes doesn't divide by w and culls those tiles.
+bool TileGenerator::generateTiles(glm::vec2 const p1, glm::vec2 const p2, glm::vec4 const (&clip)[4], int const depth, unsigned planesInside, TileSink &sink)
+	{
+	++sink.nodes;
+	if (sink.maxDepth < depth)
+		sink.maxDepth = depth;
+
+	if (depth == MAX_SUBDIVISION_DEPTH)
+		{
+		sink.tiles->emplace_back(p1, p2, depth, glm::vec4(1.f, 1.f, 1.f, 1.f));
+		return true;
+		}
+
+	glm::vec2 const corners[] =
+		{							//		0		1
+		glm::vec2(p1.x, p1.y),		//	 P1	+-------+ 
+		glm::vec2(p2.x, p1.y),		//		|		|
+		glm::vec2(p2.x, p2.y),		//		|		|
+		glm::vec2(p1.x, p2.y)		//		+-------+ P2
+		};							//		3		2
+
+	bool const planeCulling = _cullMode == CullMode::FrustumPlanes;
+	if (planeCulling && planesInside != ALL_FRUSTUM_PLANES && !cullAgainstPlanes(p1, p2, planesInside))
+		return false;
+
+	glm::vec4 projected[] = { clip[0], clip[1], clip[2], clip[3] };
+
+	int behindCount = 0;
+	for (int i = 0; i < 4; ++i)
+		if (projected[i].w < 0)
+			{
+			++behindCount;
+			projected[i].w = std::abs(projected[i].w);
+			}
+
+	if (behindCount == 4 && !planeCulling)
+		return false;
+
+	glm::vec3 screenCorners[] =
+		{
+		glm::vec3(projected[0].x, projected[0].y, projected[0].z) / projected[0].w,
+		glm::vec3(projected[1].x, projected[1].y, projected[1].z) / projected[1].w,
+		glm::vec3(projected[2].x, projected[2].y, projected[2].z) / projected[2].w,
+		glm::vec3(projected[3].x, projected[3].y, projected[3].z) / projected[3].w,
+		};
+
+	if (!planeCulling &&
+		((screenCorners[0].z >= 1 &&
+		screenCorners[1].z >= 1 &&
+		screenCorners[2].z >= 1 &&
+		screenCorners[3].z >= 1) ||
+		(projected[0].w <= 0.0f &&
+			projected[1].w <= 0.0f &&
+			projected[2].w <= 0.0f &&
+			projected[3].w <= 0.0f)))
+		return false; // It's outside of Z clip space
+
+	for (int dim = 0; dim <= 1 && !planeCulling; ++dim)
+		if ((screenCorners[0][dim] >= 1.f &&
+				screenCorners[1][dim] >= 1.f &&
+				screenCorners[2][dim] >= 1.f &&
+				screenCorners[3][dim] >= 1.f)
+			|| (screenCorners[0][dim] <= -1.f &&
+				screenCorners[1][dim] <= -1.f &&
+				screenCorners[2][dim] <= -1.f &&
+				screenCorners[3][dim] <= -1.f))
+			{
+			return false; // It's outside of X or Y clip space
+			}
+
+	glm::vec2 edges[] =
+		{
+		screenCorners[0] - screenCorners[1],
+		screenCorners[1] - screenCorners[2],
+		screenCorners[2] - screenCorners[3],
+		screenCorners[3] - screenCorners[0]
+		};
+
+	float lengths[] =
+		{							//			0
+		glm::length(edges[0]),		//	 	+-------+
+		glm::length(edges[1]),		//	  3 |		| 1
+		glm::length(edges[2]),		//		|		|
+		glm::length(edges[3]),		//		+-------+
+		};							//			2
+
+	if (lengths[0] <= _frameCamera.Detail &&
+		lengths[1] <= _frameCamera.Detail &&
+		lengths[2] <= _frameCamera.Detail &&
+		lengths[3] <= _frameCamera.Detail)
+		{
+		auto minLen = std::min(std::min(lengths[0], lengths[1]), std::min(lengths[2], lengths[3]));
+		sink.tiles->emplace_back(p1, p2, depth, makeTileColor(depth, minLen, _frameCamera.Detail));
+		return false;
+		}
+
+	// This check is 'redundant' with the recursive step for generating the 4 sub-quads, but
+	// it allows us to save a lot of work by using values that we've already computed and
+	// by not having to re-project/clip the quads if we already know they are small enough
+	// to not need it.
+	// The worst side-effect would be to potentially include some quads around the edges of
+	// clip space whose parent passed clipping but they themselves would not have.
+	bool quadrants[] = { false,			//		+---+---+
+		false,							//		|_0_|_1_|
+		false,							//		| 3 | 2 |
+		false							//		+---+---+
+		};
+
+	for (auto i = 0; i < 4; ++i)
+		if (lengths[i] > _frameCamera.Detail)
+			{
+			quadrants[i] = true;
+			quadrants[(i+1) & 3] = true;
+			}
+
+	auto center = (p1 + p2) * 0.5f;
+
+	// The quad lies on z=0 so the clip space transform is affine over it; the
+	// midpoint of two projected corners (before the divide) is the projection
+	// of the world space midpoint, so the children's corners come from
+	// averaging rather than another four matrix multiplies each. Only up to
+	// rounding: see setProjectedCorners for the difference it makes.
+	glm::vec4 childClip[4][4];
+	if (_projectedCorners)
+		for (int i = 0; i < 4; ++i)
+			projectQuad(_frameCamera.ViewProj, corners[i], center, childClip[i]);
+	else
+		{
+		glm::vec4 const edgeMids[] =
+			{									//			0
+			(clip[0] + clip[1]) * 0.5f,			//	 	+---+---+
+			(clip[1] + clip[2]) * 0.5f,			//	  3 |	c	| 1
+			(clip[2] + clip[3]) * 0.5f,			//		+---+---+
+			(clip[3] + clip[0]) * 0.5f			//			2
+			};
+		auto clipCenter = (clip[0] + clip[2]) * 0.5f;
+
+		// quadrant i spans corners[i] to the center, its corners in the same order as ours
+		childClip[0][0] = clip[0];	childClip[0][1] = edgeMids[0];	childClip[0][2] = clipCenter;	childClip[0][3] = edgeMids[3];
+		childClip[1][0] = clip[1];	childClip[1][1] = edgeMids[0];	childClip[1][2] = clipCenter;	childClip[1][3] = edgeMids[1];
+		childClip[2][0] = clip[2];	childClip[2][1] = edgeMids[2];	childClip[2][2] = clipCenter;	childClip[2][3] = edgeMids[1];
+		childClip[3][0] = clip[3];	childClip[3][1] = edgeMids[2];	childClip[3][2] = clipCenter;	childClip[3][3] = edgeMids[3];
+		}
+
+	auto result = false;
+	for (auto i = 0; i < 4; ++i)
+		{
+		// the plane test is cheap enough to not skip for the quadrants we
+		// emit directly, which is where the tiles behind the camera came from
+		auto quadrantInside = planesInside;
+		if (!quadrants[i] && planeCulling && !cullAgainstPlanes(corners[i], center, quadrantInside))
+			continue;
+
+		if (!quadrants[i])
+			sink.tiles->emplace_back(corners[i], center, depth + 1, makeTileColor(depth, lengths[i], _frameCamera.Detail));
+		else if (depth + 1 == sink.spawnDepth)
+			{
+			// the worker that runs it fills in the rest
+			SubtreeTask task = { corners[i], center, { childClip[i][0], childClip[i][1], childClip[i][2], childClip[i][3] }, depth + 1, planesInside, sink.tiles->size(),
+				-1, 0, 0, 0, 0 };
+			_subtreeTasks.push_back(task);
+			}
+		else
+			result |= generateTiles(corners[i], center, childClip[i], depth + 1, planesInside, sink);
+		}
+	
+	return result;
+	}
+
+// Builds _tiles for the camera with the selected traversal and records what
+// it took in _stats
+void TileGenerator::buildTiles(CameraState const &camera)
+	{
+	TraceScope scope("buildTiles", "generation");
+	auto start = std::chrono::steady_clock::now();
+	_frameCamera = camera;
+	_stats.deferred = 0;
+	_stats.budgetExhausted = false;
+	_stats.splits = _stats.merges = 0;
+	_tileMark.reserve(_tiles);
+
+	// the other traversals assume the flat quad
+	if (_terrain)
+		{
+		_tiles.clear();
+		generateTilesTerrain();
+		}
+	else
+		{
+		switch (_traversalMode)
+			{
+			case TraversalMode::Incremental:
+				// the persistent tree patches last frame's tiles rather than starting over
+				_persistentTree.update(_frameCamera, _tiles);
+				_nodesVisited = _persistentTree.evaluated();
+				_maxFrameDetail = _persistentTree.maxDepth();
+				_stats.splits = _persistentTree.splits();
+				_stats.merges = _persistentTree.merges();
+				break;
+
+			case TraversalMode::Batched:
+				_tiles.clear();
+				generateTilesBatched();
+				break;
+
+			case TraversalMode::Budgeted:
+				_tiles.clear();
+				generateTilesBudgeted();
+				break;
+
+			default:
+				_tiles.clear();
+				generateTilesRecursive();
+				break;
+			}
+		}
+
+	_tileMark.record(_tiles.size());
+	_stats.tiles = int(_tiles.size());
+	_stats.nodesVisited = _nodesVisited;
+	_stats.maxDepth = _maxFrameDetail;
+	_stats.tileBudget = _tileBudget;
+	_stats.timeBudget = _timeBudget;
+	_stats.buildMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+	}
+
+// Depth first traversal. With more than one traversal thread the tree is
+// walked serially down to _parallelDepth, the subtrees below it are run on
+// the pool into per-worker buffers, and those are spliced back in at the
+// positions the serial walk would have produced them, so the output is
+// identical to the single threaded one, order included.
+void TileGenerator::generateTilesRecursive()
+	{
+	if (_cullMode == CullMode::FrustumPlanes)
+		extractFrustumPlanes(_frameCamera.ViewProj, _frustumPlanes);
+
+	// the only full projection of the frame, everything below is averaged from these
+	glm::vec2 const rootP1(5, 5), rootP2(-5, -5);
+	glm::vec4 rootClip[4];
+	projectQuad(_frameCamera.ViewProj, rootP1, rootP2, rootClip);
+
+	TileSink sink = { &_tiles, 0, 0, 0 };
+	if (_taskPool->size() == 1)
+		{
+		generateTiles(rootP1, rootP2, rootClip, 0, 0, sink);
+		_maxFrameDetail = sink.maxDepth;
+		_nodesVisited = sink.nodes;
+		return;
+		}
+
+	_subtreeTasks.clear();
+	_subtreeMark.reserve(_subtreeTasks);
+	sink.spawnDepth = _parallelDepth;
+	generateTiles(rootP1, rootP2, rootClip, 0, 0, sink);
+	_subtreeMark.record(_subtreeTasks.size());
+
+	for (auto &tiles : _workerTiles)
+		{
+		tiles.clear();
+		_workerTileMark.reserve(tiles);
+		}
+
+	for (size_t i = 0; i < _subtreeTasks.size(); ++i)
+		_taskPool->push([this, i](int worker)
+			{
+			auto &task = _subtreeTasks[i];
+			TileSink workerSink = { &_workerTiles[worker], 0, 0, 0 };
+			task.worker = worker;
+			task.begin = workerSink.tiles->size();
+			generateTiles(task.p1, task.p2, task.clip, task.depth, task.planesInside, workerSink);
+			task.end = workerSink.tiles->size();
+			task.maxDepth = workerSink.maxDepth;
+			task.nodes = workerSink.nodes;
+			});
+	_taskPool->run();
+
+	// splice the subtree output back in between the tiles emitted above the split
+	_tileMark.reserve(_mergeTiles);
+	_mergeTiles.swap(_tiles);
+	_tiles.clear();
+
+	size_t total = _mergeTiles.size();
+	for (auto &tiles : _workerTiles)
+		{
+		total += tiles.size();
+		_workerTileMark.record(tiles.size());
+		}
+	_tiles.reserve(total);
+
+	size_t from = 0;
+	for (auto &task : _subtreeTasks)
+		{
+		auto &tiles = _workerTiles[task.worker];
+		_tiles.insert(_tiles.end(), _mergeTiles.begin() + from, _mergeTiles.begin() + task.insertAt);
+		_tiles.insert(_tiles.end(), tiles.begin() + task.begin, tiles.begin() + task.end);
+		from = task.insertAt;
+		sink.maxDepth = std::max(sink.maxDepth, task.maxDepth);
+		sink.nodes += task.nodes;
+		}
+	_tiles.insert(_tiles.end(), _mergeTiles.begin() + from, _mergeTiles.end());
+
+	_maxFrameDetail = sink.maxDepth;
+	_nodesVisited = sink.nodes;
+	}
+
+// Terrain version of generateTilesRecursive, on the calling thread
+void TileGenerator::generateTilesTerrain()
+	{
+	if (_cullMode == CullMode::FrustumPlanes)
+		extractFrustumPlanes(_frameCamera.ViewProj, _frustumPlanes);
+
+	glm::vec2 const rootP1(5, 5), rootP2(-5, -5);
+	glm::vec4 const rootClip[] =
+		{
+		_frameCamera.ViewProj * glm::vec4(rootP1.x, rootP1.y, 0, 1),
+		_frameCamera.ViewProj * glm::vec4(rootP2.x, rootP1.y, 0, 1),
+		_frameCamera.ViewProj * glm::vec4(rootP2.x, rootP2.y, 0, 1),
+		_frameCamera.ViewProj * glm::vec4(rootP1.x, rootP2.y, 0, 1)
+		};
+
+	// the root is drawn whether or not it has loaded, there's nothing
+	// coarser to stand in for it
+	if (_loader)
+		{
+		_loader->beginFrame();
+		auto root = makeTileKey(glm::uvec2(0), 0);
+		if (!_loader->resident(root))
+			_loader->request(root, std::numeric_limits<float>::max());
+		}
+
+	TileSink sink = { &_tiles, 0, 0, 0 };
+	generateTerrainTiles(rootP1, rootP2, rootClip, 0, 0, sink);
+	if (_loader)
+		_loader->endFrame();
+	_maxFrameDetail = sink.maxDepth;
+	_nodesVisited = sink.nodes;
+	}
+
+// generateTiles over _terrain: each node is culled and measured as the box
+// spanning its elevation range, looked up in the heightfield's or the tile
+// pyramid's min/max tables, rather than as the flat quad. clip still holds
+// the flat corners, which split by averaging as before. A node is either
+// drawn or split into all four quadrants, since each quadrant has bounds of
+// its own. With a loader a node only splits once all four children have
+// loaded, until then it's drawn as it is and the missing ones requested.
+void TileGenerator::generateTerrainTiles(glm::vec2 const p1, glm::vec2 const p2, glm::vec4 const (&clip)[4], int const depth, unsigned planesInside, TileSink &sink)
+	{
+	++sink.nodes;
+	if (sink.maxDepth < depth)
+		sink.maxDepth = depth;
+
+	auto cell = tileCell(p1, p2, depth);
+	auto range = _terrain->range(cell, depth);
+	bool const planeCulling = _cullMode == CullMode::FrustumPlanes;
+	if (planeCulling && planesInside != ALL_FRUSTUM_PLANES && !cullBoxAgainstPlanes(p1, p2, range, planesInside))
+		return;
+
+	float lengths[4];
+	if (!measureBox(clip, _frameCamera.ViewProj[2], range, !planeCulling, lengths))
+		return;
+
+	if (depth == MAX_SUBDIVISION_DEPTH)
+		{
+		_terrain->prefetch(cell, depth, false);
+		sink.tiles->emplace_back(p1, p2, depth, glm::vec4(1.f, 1.f, 1.f, 1.f));
+		return;
+		}
+
+	if (lengths[0] <= _frameCamera.Detail &&
+		lengths[1] <= _frameCamera.Detail &&
+		lengths[2] <= _frameCamera.Detail &&
+		lengths[3] <= _frameCamera.Detail)
+		{
+		auto maxLen = std::max(std::max(lengths[0], lengths[1]), std::max(lengths[2], lengths[3]));
+		_terrain->prefetch(cell, depth, maxLen > PREFETCH_DETAIL_FRACTION * _frameCamera.Detail);
+		auto minLen = std::min(std::min(lengths[0], lengths[1]), std::min(lengths[2], lengths[3]));
+		sink.tiles->emplace_back(p1, p2, depth, makeTileColor(float(depth), minLen, _frameCamera.Detail));
+		return;
+		}
+
+	if (_loader && depth + 1 < _loader->levels())
+		{
+		auto maxLen = std::max(std::max(lengths[0], lengths[1]), std::max(lengths[2], lengths[3]));
+		if (!childrenLoaded(cell, depth, maxLen / _frameCamera.Detail))
+			{
+			++_stats.deferred;
+			_terrain->prefetch(cell, depth, false);
+			sink.tiles->emplace_back(p1, p2, depth, makeTileColor(float(depth), maxLen, _frameCamera.Detail));
+			return;
+			}
+		}
+
+	glm::vec2 const corners[] = { p1, glm::vec2(p2.x, p1.y), p2, glm::vec2(p1.x, p2.y) };
+	auto center = (p1 + p2) * 0.5f;
+	glm::vec4 childClip[4][4];
+	splitClipCorners(clip, childClip);
+
+	for (int i = 0; i < 4; ++i)
+		generateTerrainTiles(corners[i], center, childClip[i], depth + 1, planesInside, sink);
+	}
+
+// Whether the four children of cell, depth have loaded, asking for the
+// ones that haven't; priority is the node's screen space error
+bool TileGenerator::childrenLoaded(glm::uvec2 const cell, int const depth, float const priority)
+	{
+	uint64_t keys[4];
+	for (unsigned child = 0; child < 4; ++child)
+		keys[child] = makeTileKey(cell * 2u + glm::uvec2(child & 1, child >> 1), depth + 1);
+	return _loader->residentOrRequest(keys, 4, priority);
+	}
+
+// Breadth first version of generateTiles: each level of the tree is kept as
+// a structure-of-arrays frontier and classified in SIMD batches by
+// classifyNodes, then a scalar pass emits tiles and queues the children for
+// the next level. classifyNodes projects every node's corners, where the
+// recursive walk averages its parent's clip space corners, so the two can
+// disagree on a node whose edge is within rounding of the detail level:
+// 19 tiles over 600 frames of OnxCoreBench --path zoom, see --clip-check.
+// Otherwise the tiles are the same, level by level rather than depth first.
+void TileGenerator::generateTilesBatched()
+	{
+	_frontier.clear();
+	_frontierMark.reserve(_frontier);
+	_frontierMark.reserve(_nextFrontier);
+	_frontier.push(glm::vec2(5, 5), glm::vec2(-5, -5));
+	_nodesVisited = 0;
+	_maxFrameDetail = 0;
+	size_t widest = 0;
+
+	for (int depth = 0; _frontier.size() > 0; ++depth)
+		{
+		auto const count = _frontier.size();
+		widest = std::max(widest, count);
+		_nodesVisited += int(count);
+		_maxFrameDetail = depth;
+
+		if (depth == MAX_SUBDIVISION_DEPTH)
+			{
+			for (size_t n = 0; n < count; ++n)
+				_tiles.emplace_back(glm::vec2(_frontier.x1[n], _frontier.y1[n]), glm::vec2(_frontier.x2[n], _frontier.y2[n]), depth, glm::vec4(1.f, 1.f, 1.f, 1.f));
+			break;
+			}
+
+		classifyNodes(_frontier, _frameCamera.ViewProj, _frameCamera.Detail, _classified);
+
+		_nextFrontier.clear();
+		for (size_t n = 0; n < count; ++n)
+			{
+			if (_classified.culled[n])
+				continue;
+
+			glm::vec2 const p1(_frontier.x1[n], _frontier.y1[n]),
+				p2(_frontier.x2[n], _frontier.y2[n]);
+			float const lengths[] = { _classified.length[0][n], _classified.length[1][n], _classified.length[2][n], _classified.length[3][n] };
+
+			auto const refine = _classified.refine[n];
+			if (!refine)
+				{
+				auto minLen = std::min(std::min(lengths[0], lengths[1]), std::min(lengths[2], lengths[3]));
+				_tiles.emplace_back(p1, p2, depth, makeTileColor(depth, minLen, _frameCamera.Detail));
+				continue;
+				}
+
+			// an edge that's too long refines the two quadrants along it, same as generateTiles
+			auto const quadrants = refine | ((refine << 1) & 0xf) | (refine >> 3);
+			glm::vec2 const corners[] = { p1, glm::vec2(p2.x, p1.y), p2, glm::vec2(p1.x, p2.y) };
+			auto center = (p1 + p2) * 0.5f;
+
+			for (auto i = 0; i < 4; ++i)
+				{
+				if (quadrants & (1 << i))
+					_nextFrontier.push(corners[i], center);
+				else
+					_tiles.emplace_back(corners[i], center, depth + 1, makeTileColor(depth, lengths[i], _frameCamera.Detail));
+				}
+			}
+
+		std::swap(_frontier, _nextFrontier);
+		}
+	_frontierMark.record(widest);
+	}
+
+// Best first version of generateTiles for bounded frame times: nodes that
+// still need refining wait in a max-heap on their longest projected edge and
+// the worst one is split next, until none are left or the tile or time
+// budget runs out. Whatever is still queued then is drawn unrefined, so the
+// result is the most detailed tile set that fits the budget. Splitting
+// follows the same rules as generateTiles; with no budget it produces the
+// same tiles, in a different order.
+void TileGenerator::generateTilesBudgeted()
+	{
+	bool const planeCulling = _cullMode == CullMode::FrustumPlanes;
+	if (planeCulling)
+		extractFrustumPlanes(_frameCamera.ViewProj, _frustumPlanes);
+
+	auto start = std::chrono::steady_clock::now();
+	size_t const tileLimit = _tileBudget > 0 ? size_t(_tileBudget) : SIZE_MAX;
+	_refineNodes.clear();
+	_refineQueue.clear();
+	_refineMark.reserve(_refineNodes);
+	_refineMark.reserve(_refineQueue);
+	_nodesVisited = 0;
+	_maxFrameDetail = 0;
+
+	// emits the node as a tile or queues it for refining
+	auto classify = [&](glm::vec2 const &p1, glm::vec2 const &p2, glm::vec4 const (&clip)[4], int depth, unsigned planesInside)
+		{
+		++_nodesVisited;
+		_maxFrameDetail = std::max(_maxFrameDetail, depth);
+
+		if (depth == MAX_SUBDIVISION_DEPTH)
+			{
+			_tiles.emplace_back(p1, p2, depth, glm::vec4(1.f, 1.f, 1.f, 1.f));
+			return;
+			}
+
+		if (planeCulling && planesInside != ALL_FRUSTUM_PLANES && !cullAgainstPlanes(p1, p2, planesInside))
+			return;
+
+		float lengths[4];
+		if (!measureQuad(clip, !planeCulling, lengths))
+			return;
+
+		auto error = std::max(std::max(lengths[0], lengths[1]), std::max(lengths[2], lengths[3]));
+		if (error <= _frameCamera.Detail)
+			{
+			auto minLen = std::min(std::min(lengths[0], lengths[1]), std::min(lengths[2], lengths[3]));
+			_tiles.emplace_back(p1, p2, depth, makeTileColor(float(depth), minLen, _frameCamera.Detail));
+			return;
+			}
+
+		RefineNode node = { p1, p2, { clip[0], clip[1], clip[2], clip[3] }, { lengths[0], lengths[1], lengths[2], lengths[3] }, depth, planesInside };
+		_refineQueue.push_back({ error, int(_refineNodes.size()) });
+		_refineNodes.push_back(node);
+		std::push_heap(_refineQueue.begin(), _refineQueue.end());
+		};
+
+	glm::vec2 const rootP1(5, 5), rootP2(-5, -5);
+	glm::vec4 const rootClip[] =
+		{
+		_frameCamera.ViewProj * glm::vec4(rootP1.x, rootP1.y, 0, 1),
+		_frameCamera.ViewProj * glm::vec4(rootP2.x, rootP1.y, 0, 1),
+		_frameCamera.ViewProj * glm::vec4(rootP2.x, rootP2.y, 0, 1),
+		_frameCamera.ViewProj * glm::vec4(rootP1.x, rootP2.y, 0, 1)
+		};
+	classify(rootP1, rootP2, rootClip, 0, 0);
+
+	for (int splits = 0; !_refineQueue.empty(); ++splits)
+		{
+		// a split turns one queued node into at most four tiles
+		if (_tiles.size() + _refineQueue.size() + 3 > tileLimit)
+			break;
+
+		// reading the clock isn't free, only look every few splits; leave
+		// time to turn what's still queued into tiles
+		if (_timeBudget > 0 && (splits & 15) == 0)
+			{
+			auto elapsed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+			if (elapsed + _flushMicroseconds * _refineQueue.size() >= _timeBudget)
+				break;
+			}
+
+		std::pop_heap(_refineQueue.begin(), _refineQueue.end());
+		auto const node = _refineNodes[_refineQueue.back().node];
+		_refineQueue.pop_back();
+
+		glm::vec2 const corners[] = { node.p1, glm::vec2(node.p2.x, node.p1.y), node.p2, glm::vec2(node.p1.x, node.p2.y) };
+		auto center = (node.p1 + node.p2) * 0.5f;
+
+		glm::vec4 childClip[4][4];
+		splitClipCorners(node.clip, childClip);
+
+		// same quadrant rule as generateTiles, an edge that's too long refines
+		// the two quadrants along it and the others are emitted as they are
+		unsigned quadrants = 0;
+		for (int i = 0; i < 4; ++i)
+			if (node.lengths[i] > _frameCamera.Detail)
+				quadrants |= (1u << i) | (1u << ((i + 1) & 3));
+
+		for (int i = 0; i < 4; ++i)
+			{
+			if (quadrants & (1u << i))
+				{
+				classify(corners[i], center, childClip[i], node.depth + 1, node.planesInside);
+				continue;
+				}
+
+			auto quadrantInside = node.planesInside;
+			if (!planeCulling || cullAgainstPlanes(corners[i], center, quadrantInside))
+				_tiles.emplace_back(corners[i], center, node.depth + 1, makeTileColor(float(node.depth), node.lengths[i], _frameCamera.Detail));
+			}
+		}
+
+	_refineMark.record(_refineNodes.size());
+	_stats.deferred = int(_refineQueue.size());
+	_stats.budgetExhausted = !_refineQueue.empty();
+	if (_refineQueue.empty())
+		return;
+
+	auto flushStart = std::chrono::steady_clock::now();
+	for (auto &entry : _refineQueue)
+		{
+		auto const &node = _refineNodes[entry.node];
+		auto minLen = std::min(std::min(node.lengths[0], node.lengths[1]), std::min(node.lengths[2], node.lengths[3]));
+		_tiles.emplace_back(node.p1, node.p2, node.depth, makeTileColor(float(node.depth), minLen, _frameCamera.Detail));
+		}
+
+	// the next frame's time budget sets this much aside per queued node
+	auto flushed = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - flushStart).count();
+	_flushMicroseconds = glm::mix(_flushMicroseconds, flushed / _refineQueue.size(), 0.25f);
+	}
+
+// Tile and time limits for TraversalMode::Budgeted, 0 for no limit; can be
+// changed between frames
+void TileGenerator::setRefineBudget(int maxTiles, int maxMicroseconds)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_tileBudget = std::max(maxTiles, 0);
+	_timeBudget = std::max(maxMicroseconds, 0);
+	_settingsChanged = true;
+	}
+
+// Gets the tiles for this frame ready, returns false if there's nothing new
+// to draw. Synchronously that means building them for the camera if it
+// moved; with the generation thread it posts the camera to it and picks up
+// the newest tiles it has finished, which may be for an earlier camera.
+bool TileGenerator::update(CameraState const &camera, bool cameraMoved)
+	{
+	cameraMoved |= _settingsChanged;
+	_settingsChanged = false;
+	// tiles that have loaded since let the terrain refine further
+	if (_loader && _loader->takeArrivals())
+		cameraMoved = true;
+
+	if (!_asyncGeneration)
+		{
+		if (!cameraMoved)
+			return false;
+
+		buildTiles(camera);
+		return true;
+		}
+
+	auto fresh = (_readyFrame.load() & FRAME_FRESH) != 0;
+	if (fresh)
+		_drawFrame = _readyFrame.exchange(_drawFrame) & FRAME_INDEX;
+
+	if (cameraMoved)
+		requestTiles(camera);
+	return fresh || cameraMoved;
+	}
+
+TileList const &TileGenerator::drawnTiles() const
+	{
+	return _asyncGeneration ? _frames[_drawFrame].tiles : _tiles;
+	}
+
+// Stats of the traversal behind the tiles last drawn
+TraversalStats const &TileGenerator::traversalStats() const
+	{
+	return _asyncGeneration ? _frames[_drawFrame].stats : _stats;
+	}
+
+// Hands the generation thread a camera to build tiles for; if it's busy the
+// newest request replaces any it hasn't started on yet
+void TileGenerator::requestTiles(CameraState const &camera)
+	{
+		{
+		std::lock_guard<std::mutex> lock(_requestMutex);
+		_requestedCamera = camera;
+		_requestedTraceFrame = TraceRecorder::frame();
+		_cameraRequested = true;
+		}
+	_requestChanged.notify_one();
+	}
+
+void TileGenerator::generationLoop()
+	{
+	TraceRecorder::setThreadName("generation");
+	for (;;)
+		{
+		CameraState camera;
+			{
+			std::unique_lock<std::mutex> lock(_requestMutex);
+			_requestChanged.wait(lock, [this] { return _cameraRequested || _stopGeneration; });
+			if (_stopGeneration)
+				return;
+
+			camera = _requestedCamera;
+			TraceRecorder::setThreadCameraFrame(_requestedTraceFrame);
+			_cameraRequested = false;
+			}
+
+		std::lock_guard<std::mutex> lock(_generationMutex);
+		buildTiles(camera);
+
+		// the persistent tree patches _tiles next frame so it has to be
+		// copied, every other traversal starts from an empty list
+		auto &frame = _frames[_buildFrame];
+		if (_traversalMode == TraversalMode::Incremental)
+			{
+			_tileMark.reserve(frame.tiles);
+			frame.tiles = _tiles;
+			}
+		else
+			frame.tiles.swap(_tiles);
+		frame.stats = _stats;
+
+		_buildFrame = _readyFrame.exchange(_buildFrame | FRAME_FRESH) & FRAME_INDEX;
+		}
+	}
+
+// Moves tile generation to its own thread so a slow traversal doesn't hold
+// up drawing and input; update then hands out the newest complete tile set
+// while the next one is built
+void TileGenerator::setAsyncGeneration(bool async)
+	{
+	if (async == _asyncGeneration)
+		return;
+
+	if (async)
+		{
+		// the slots start out with whatever was last drawn
+		for (auto &frame : _frames)
+			{
+			frame.tiles = _tiles;
+			frame.stats = _stats;
+			}
+		_drawFrame = 0;
+		_readyFrame = 1;
+		_buildFrame = 2;
+		_stopGeneration = false;
+		_asyncGeneration = true;
+		_generationThread = std::thread(&TileGenerator::generationLoop, this);
+		}
+	else
+		{
+			{
+			std::lock_guard<std::mutex> lock(_requestMutex);
+			_stopGeneration = true;
+			}
+		_requestChanged.notify_one();
+		_generationThread.join();
+		_asyncGeneration = false;
+
+		// the persistent tree's list has to stay the one it last patched
+		if (_traversalMode != TraversalMode::Incremental)
+			_tiles = _frames[_drawFrame].tiles;
+		}
+	_settingsChanged = true;
+	}
+
+// Raises the quadtree onto a heightfield, or back to the flat quad with
+// null; the heightfield is shared with whoever draws the tiles
+void TileGenerator::setHeightfield(std::shared_ptr<Heightfield const> heightfield)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_heightfield = std::move(heightfield);
+	_pyramid = nullptr;
+	_terrain = _heightfield;
+	_loader = nullptr;
+	_persistentTree.reset();
+	_settingsChanged = true;
+	}
+
+// The same over a memory mapped tile pyramid, which replaces any heightfield
+void TileGenerator::setTilePyramid(std::shared_ptr<TilePyramid const> pyramid)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_pyramid = std::move(pyramid);
+	_heightfield = nullptr;
+	_terrain = _pyramid;
+	_loader = nullptr;
+	_persistentTree.reset();
+	_settingsChanged = true;
+	}
+
+// Has terrain traversals refine only into tiles the loader has loaded, or
+// into any with null. It loads from one pyramid, so it's dropped whenever
+// the terrain is changed and has to be set after setTilePyramid.
+void TileGenerator::setTileLoader(std::shared_ptr<TileLoader> loader)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_loader = std::move(loader);
+	_settingsChanged = true;
+	}
+
+// Has the recursive traversal project every node's corners rather than
+// average them from its parent's, the way it used to. Averaging rounds
+// differently, so a node whose edge length or clip test is within rounding
+// of its threshold can go the other way; OnxCoreBench --clip-check measures
+// both and diffs the tiles.
+void TileGenerator::setProjectedCorners(bool projected)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_projectedCorners = projected;
+	_settingsChanged = true;
+	}
+
+// Picks how the recursive traversal culls, see CullMode
+void TileGenerator::setCullMode(CullMode mode)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_cullMode = mode;
+	_settingsChanged = true;
+	}
+
+// Picks the traversal buildTiles uses, see TraversalMode
+void TileGenerator::setTraversalMode(TraversalMode mode)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_traversalMode = mode;
+	_persistentTree.reset();
+	_settingsChanged = true;
+	}
+
+// Number of threads used to walk the quadtree, 1 keeps the traversal
+// entirely on the calling thread
+void TileGenerator::setTraversalThreads(int threads)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	threads = std::max(threads, 1);
+	_taskPool.reset(new TaskPool(threads));
+	_workerTiles.resize(threads);
+	_settingsChanged = true;
+	}
+
+// Depth below which subtrees become pool tasks; deeper means more, smaller
+// tasks (4^depth at most) and more serial work at the top of the tree
+void TileGenerator::setParallelDepth(int depth)
+	{
+	std::lock_guard<std::mutex> lock(_generationMutex);
+	_parallelDepth = std::min(std::max(depth, 1), MAX_SUBDIVISION_DEPTH);
+	_settingsChanged = true;
+	}
@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FrameMemory.h"
+#include "Heightfield.h"
+#include "PersistentQuadtree.h"
+#include "TaskPool.h"
+#include "TileBatch.h"
+#include "TileLoader.h"
+#include "TilePyramid.h"
+#include "Types.h"
+
+constexpr int DEFAULT_PARALLEL_DEPTH = 4;
+constexpr unsigned ALL_FRUSTUM_PLANES = 0x3f;
+
+// How the quadtree is walked: depth first one node at a time (optionally
+// split across the task pool), breadth first a level at a time with the
+// per node tests run in SIMD batches, kept from frame to frame and only
+// split/merged where the camera movement requires it, or best first by
+// screen space error until the refinement budget runs out. With a
+// heightfield or tile pyramid set buildTiles walks the terrain depth first
+// whatever the mode.
+enum class TraversalMode
+	{
+	Recursive,
+	Batched,
+	Incremental,
+	Budgeted
+	};
+
+// How generateTiles rejects quads: dividing the projected corners by w and
+// testing them against the NDC cube, or testing the quad against the six
+// frustum planes, skipping planes the parent was already entirely inside of
+enum class CullMode
+	{
+	ClipSpace,
+	FrustumPlanes
+	};
+
+// Where a traversal writes its tiles; the serial path writes straight into
+// _tiles, pool workers each own a buffer so nothing is shared while walking
+struct TileSink
+	{
+	TileList *tiles;
+	int maxDepth;
+	int nodes;
+	int spawnDepth; // children at this depth are deferred to the pool, 0 = never
+	};
+
+// A subtree handed to the pool, and where its tiles ended up
+struct SubtreeTask
+	{
+	glm::vec2 p1;
+	glm::vec2 p2;
+	glm::vec4 clip[4];
+	int depth;
+	unsigned planesInside;
+	size_t insertAt; // position in the serial output the subtree's tiles belong
+	int worker;
+	size_t begin;
+	size_t end;
+	int maxDepth;
+	int nodes;
+	};
+
+// A node waiting to be refined in TraversalMode::Budgeted
+struct RefineNode
+	{
+	glm::vec2 p1;
+	glm::vec2 p2;
+	glm::vec4 clip[4];
+	float lengths[4];
+	int depth;
+	unsigned planesInside;
+	};
+
+// Heap entry for a RefineNode, ordered by its longest projected edge; kept
+// apart from the node so the heap only moves a few bytes around
+struct RefineEntry
+	{
+	float error;
+	int node;
+
+	bool operator<(RefineEntry const &other) const { return error < other.error; }
+	};
+
+// What the last buildTiles did, for overlays and benchmarks
+struct TraversalStats
+	{
+	int tiles;
+	int nodesVisited;
+	int maxDepth;
+	float buildMicroseconds;
+	int tileBudget;			// TraversalMode::Budgeted limits, 0 = unlimited
+	int timeBudget;			// microseconds
+	int deferred;			// nodes drawn unrefined because the budget ran out,
+							// or because their children hadn't loaded
+	bool budgetExhausted;
+	int splits;				// TraversalMode::Incremental's changes to its
+	int merges;				// persistent tree, 0 for the others
+	};
+
+// A published tile list and the stats of the traversal that built it
+struct TileFrame
+	{
+	TileList tiles;
+	TraversalStats stats;
+	};
+
+// Turns camera snapshots into the quadtree tiles to draw. Knows nothing
+// about OpenGL or the window, so it can be driven headless as well.
+class TileGenerator
+{
+public:
+	TileGenerator();
+	~TileGenerator();
+
+	bool update(CameraState const &camera, bool cameraMoved);
+	TileList const &drawnTiles() const;
+	TraversalStats const &traversalStats() const;
+
+	void setTraversalThreads(int threads);
+	void setParallelDepth(int depth);
+	void setTraversalMode(TraversalMode mode);
+	void setCullMode(CullMode mode);
+	void setProjectedCorners(bool projected);
+	void setRefineBudget(int maxTiles, int maxMicroseconds);
+	void setAsyncGeneration(bool async);
+	void setHeightfield(std::shared_ptr<Heightfield const> heightfield);
+	std::shared_ptr<Heightfield const> const &heightfield() const { return _heightfield; }
+	void setTilePyramid(std::shared_ptr<TilePyramid const> pyramid);
+	std::shared_ptr<TilePyramid const> const &tilePyramid() const { return _pyramid; }
+	void setTileLoader(std::shared_ptr<TileLoader> loader);
+	std::shared_ptr<TileLoader> const &tileLoader() const { return _loader; }
+
+private:
+	int _maxFrameDetail = 0;
+	int _nodesVisited = 0;
+	TraversalMode _traversalMode = TraversalMode::Recursive;
+	CullMode _cullMode = CullMode::ClipSpace;
+	bool _projectedCorners = false;	// the reference for averaging them, see setProjectedCorners
+	int _parallelDepth = DEFAULT_PARALLEL_DEPTH;
+	int _tileBudget = 0,
+		_timeBudget = 0;
+	bool _settingsChanged = true;	// forces a build on the next update
+	TraversalStats _stats = {};
+
+	TileList _tiles;	// the generators' working list
+	CameraState _frameCamera;	// the camera _tiles is being built for
+	std::unique_ptr<TaskPool> _taskPool;
+	std::vector<TileList> _workerTiles;
+	std::vector<SubtreeTask> _subtreeTasks;
+	TileList _mergeTiles;
+	NodeFrontier _frontier,
+		_nextFrontier;
+	NodeClassification _classified;
+	PersistentQuadtree _persistentTree;
+	std::vector<RefineNode> _refineNodes;
+	std::vector<RefineEntry> _refineQueue;
+
+	// sizes the lists above are reserved to before each build, so a warmed
+	// up frame doesn't allocate
+	HighWaterMark _tileMark,
+		_workerTileMark,
+		_subtreeMark,
+		_frontierMark,
+		_refineMark;
+	float _flushMicroseconds = 0.02f;	// per queued node, measured
+	glm::vec4 _frustumPlanes[6];
+	std::shared_ptr<Heightfield const> _heightfield;
+	std::shared_ptr<TilePyramid const> _pyramid;
+	std::shared_ptr<ElevationBounds const> _terrain;	// whichever of the two is set, null for the flat quad
+	std::shared_ptr<TileLoader> _loader;	// if set, terrain nodes only refine into loaded tiles
+
+	// Asynchronous generation: update posts camera snapshots, the generation
+	// thread builds tiles for the latest one and publishes them through three
+	// frame slots; the one being drawn, the newest complete one and the one
+	// being built, handed over with atomic exchanges so neither side waits
+	static constexpr int FRAME_INDEX = 3,
+		FRAME_FRESH = 4;	// set on _readyFrame when it hasn't been drawn yet
+
+	bool _asyncGeneration = false;
+	std::thread _generationThread;
+	std::mutex _generationMutex;	// held while building, and by setters changing how tiles are built
+	std::mutex _requestMutex;
+	std::condition_variable _requestChanged;
+	CameraState _requestedCamera;
+	int _requestedTraceFrame = -1;	// the trace frame _requestedCamera came from
+	bool _cameraRequested = false,
+		_stopGeneration = false;
+	TileFrame _frames[3];
+	std::atomic<int> _readyFrame { 1 };
+	int _drawFrame = 0,
+		_buildFrame = 2;
+
+	void buildTiles(CameraState const &camera);
+	void requestTiles(CameraState const &camera);
+	void generationLoop();
+	void generateTilesRecursive();
+	void generateTilesBatched();
+	void generateTilesBudgeted();
+	void generateTilesTerrain();
+	bool generateTiles(glm::vec2 const p1, glm::vec2 const p2, glm::vec4 const (&clip)[4], int const depth, unsigned planesInside, TileSink &sink);
+	void generateTerrainTiles(glm::vec2 const p1, glm::vec2 const p2, glm::vec4 const (&clip)[4], int const depth, unsigned planesInside, TileSink &sink);
+	bool childrenLoaded(glm::uvec2 const cell, int const depth, float const priority);
+	bool cullAgainstPlanes(glm::vec2 const p1, glm::vec2 const p2, unsigned &planesInside) const;
+	bool cullBoxAgainstPlanes(glm::vec2 const p1, glm::vec2 const p2, glm::vec2 const range, unsigned &planesInside) const;
+};
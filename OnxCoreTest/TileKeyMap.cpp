@@ -0,0 +1,73 @@
+#include "TileKeyMap.h"
+#include <algorithm>
+
+uint32_t const *TileKeyMap::find(uint64_t key) const
+	{
+	if (_entries.empty())
+		return nullptr;
+
+	for (auto i = home(key); ; i = (i + 1) & (_entries.size() - 1))
+		{
+		if (_entries[i].key == key)
+			return &_entries[i].slot;
+		if (_entries[i].key == NO_TILE_KEY)
+			return nullptr;
+		}
+	}
+
+// The key mustn't be in the map already
+void TileKeyMap::insert(uint64_t key, uint32_t slot)
+	{
+	if (2 * (_count + 1) > _entries.size())
+		grow();
+
+	auto i = home(key);
+	while (_entries[i].key != NO_TILE_KEY)
+		i = (i + 1) & (_entries.size() - 1);
+	_entries[i] = { key, slot };
+	++_count;
+	}
+
+void TileKeyMap::erase(uint64_t key)
+	{
+	if (_entries.empty())
+		return;
+
+	auto const mask = _entries.size() - 1;
+	auto i = home(key);
+	for (; _entries[i].key != key; i = (i + 1) & mask)
+		if (_entries[i].key == NO_TILE_KEY)
+			return;
+
+	// pull back every later entry in the run that may sit in the gap, i.e.
+	// whose home isn't between the gap and where it is now
+	for (auto j = (i + 1) & mask; _entries[j].key != NO_TILE_KEY; j = (j + 1) & mask)
+		{
+		auto wanted = home(_entries[j].key);
+		if (((j - wanted) & mask) >= ((j - i) & mask))
+			{
+			_entries[i] = _entries[j];
+			i = j;
+			}
+		}
+	_entries[i].key = NO_TILE_KEY;
+	--_count;
+	}
+
+// Keeps the table's storage
+void TileKeyMap::clear()
+	{
+	for (auto &entry : _entries)
+		entry.key = NO_TILE_KEY;
+	_count = 0;
+	}
+
+void TileKeyMap::grow()
+	{
+	std::vector<Entry> old(std::max<size_t>(2 * _entries.size(), 1024), Entry { NO_TILE_KEY, 0 });
+	old.swap(_entries);
+	_count = 0;
+	for (auto &entry : old)
+		if (entry.key != NO_TILE_KEY)
+			insert(entry.key, entry.slot);
+	}
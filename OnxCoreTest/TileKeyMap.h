@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Never a real tile key, its depth bits are out of range
+constexpr uint64_t NO_TILE_KEY = ~uint64_t(0);
+
+// Tile key to slot lookup, open addressed with linear probing so it's one
+// flat array rather than a node allocated per key; erasing shifts the
+// entries after it back rather than leaving tombstones, so it never needs
+// rebuilding and only allocates when it grows
+class TileKeyMap
+{
+public:
+	uint32_t const *find(uint64_t key) const;
+	void insert(uint64_t key, uint32_t slot);
+	void erase(uint64_t key);
+	void clear();
+
+private:
+	struct Entry
+		{
+		uint64_t key;	// NO_TILE_KEY when empty
+		uint32_t slot;
+		};
+
+	std::vector<Entry> _entries;	// a power of two, at most half full
+	size_t _count = 0;
+
+	size_t home(uint64_t key) const
+		{
+		return size_t((key * 0x9e3779b97f4a7c15ull) >> 32) & (_entries.size() - 1);
+		}
+	void grow();
+};
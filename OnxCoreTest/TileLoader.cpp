@@ -0,0 +1,279 @@
+#include "TileLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "TraceRecorder.h"
+#include "Types.h"
+
+PyramidTileSource::PyramidTileSource(std::shared_ptr<TilePyramid const> pyramid, int latencyMicroseconds)
+	: _pyramid(std::move(pyramid)), _latencyMicroseconds(latencyMicroseconds)
+	{
+	}
+
+size_t PyramidTileSource::load(uint64_t key) const
+	{
+	auto depth = tileKeyDepth(key);
+	auto cell = tileKeyCell(key);
+	if (depth >= _pyramid->levels() || cell.x >> depth || cell.y >> depth)
+		return 0;
+
+	if (_latencyMicroseconds > 0)
+		std::this_thread::sleep_for(std::chrono::microseconds(_latencyMicroseconds));
+
+	return _pyramid->load(cell, depth);
+	}
+
+void PyramidTileSource::unload(uint64_t key) const
+	{
+	_pyramid->unload(tileKeyCell(key), tileKeyDepth(key));
+	}
+
+TileLoader::TileLoader(std::shared_ptr<TileSource const> source, size_t budgetBytes, int threads)
+	: _source(std::move(source)), _budgetBytes(budgetBytes)
+	{
+	for (int i = 0; i < std::max(threads, 1); ++i)
+		_threads.emplace_back(&TileLoader::ioLoop, this, i);
+	}
+
+TileLoader::~TileLoader()
+	{
+		{
+		std::lock_guard<std::mutex> lock(_lock);
+		_quit = true;
+		}
+	_work.notify_all();
+	for (auto &thread : _threads)
+		thread.join();
+	}
+
+void TileLoader::beginFrame()
+	{
+	std::lock_guard<std::mutex> lock(_lock);
+	++_frame;
+	}
+
+// Asks for a tile this frame, higher priorities load first; a request
+// repeated within a frame keeps the highest priority it was given
+void TileLoader::request(uint64_t key, float priority)
+	{
+	std::lock_guard<std::mutex> lock(_lock);
+	queue(key, priority);
+	}
+
+// True if the tile has loaded; counts as using it this frame, so it won't
+// be evicted until the next
+bool TileLoader::resident(uint64_t key)
+	{
+	std::lock_guard<std::mutex> lock(_lock);
+	return use(key);
+	}
+
+// resident for each key, requesting the ones that aren't, under one lock;
+// true if they all are
+bool TileLoader::residentOrRequest(uint64_t const *keys, int count, float priority)
+	{
+	std::lock_guard<std::mutex> lock(_lock);
+	bool all = true;
+	for (int i = 0; i < count; ++i)
+		if (!use(keys[i]))
+			{
+			queue(keys[i], priority);
+			all = false;
+			}
+	return all;
+	}
+
+// Drops the queued tiles this frame didn't ask for, they've fallen out of
+// view or been drawn coarser, and hands the rest to the I/O threads in
+// priority order. Loads already under way are left to finish. Tiles that
+// loaded while the cache was held over budget by the last frame's can be
+// evicted now this frame has marked the ones it still uses.
+void TileLoader::endFrame()
+	{
+		{
+		std::lock_guard<std::mutex> lock(_lock);
+		evict();
+		_queue.clear();
+		for (uint32_t slot = 0; slot < _entries.size(); ++slot)
+			{
+			auto &entry = _entries[slot];
+			if (entry.state != State::Queued)
+				continue;
+			if (entry.frame == _frame)
+				_queue.push({ entry.priority, slot });
+			else
+				{
+				release(slot);
+				++_stats.cancelled;
+				}
+			}
+		}
+	_work.notify_all();
+	}
+
+// True once after any tiles have arrived, so the caller knows a new
+// traversal could refine further
+bool TileLoader::takeArrivals()
+	{
+	std::lock_guard<std::mutex> lock(_lock);
+	auto arrived = _arrived;
+	_arrived = false;
+	return arrived;
+	}
+
+LoaderStats TileLoader::stats() const
+	{
+	std::lock_guard<std::mutex> lock(_lock);
+	auto stats = _stats;
+	stats.queued = int(_queue.size());
+	return stats;
+	}
+
+uint32_t TileLoader::allocate(uint64_t key)
+	{
+	uint32_t slot;
+	if (_freeSlots.empty())
+		{
+		slot = uint32_t(_entries.size());
+		_entries.emplace_back();
+		}
+	else
+		{
+		slot = _freeSlots.back();
+		_freeSlots.pop_back();
+		}
+
+	auto &entry = _entries[slot];
+	entry.key = key;
+	entry.state = State::Queued;
+	entry.priority = 0.f;
+	entry.frame = _frame;
+	entry.newer = entry.older = -1;
+	_slotOfKey.insert(key, slot);
+	return slot;
+	}
+
+void TileLoader::release(uint32_t slot)
+	{
+	auto &entry = _entries[slot];
+	_slotOfKey.erase(entry.key);
+	entry.key = NO_TILE_KEY;
+	entry.state = State::Free;
+	_freeSlots.push_back(slot);
+	}
+
+bool TileLoader::use(uint64_t key)
+	{
+	auto found = _slotOfKey.find(key);
+	if (!found || _entries[*found].state != State::Resident)
+		return false;
+	touch(*found);
+	_entries[*found].frame = _frame;
+	return true;
+	}
+
+void TileLoader::queue(uint64_t key, float priority)
+	{
+	auto found = _slotOfKey.find(key);
+	auto slot = found ? *found : allocate(key);
+	auto &entry = _entries[slot];
+	if (entry.state == State::Queued && (entry.frame != _frame || entry.priority < priority))
+		entry.priority = priority;
+	if (entry.state == State::Resident)
+		touch(slot);
+	entry.frame = _frame;
+	}
+
+void TileLoader::unlink(uint32_t slot)
+	{
+	auto &entry = _entries[slot];
+	if (entry.newer >= 0)
+		_entries[entry.newer].older = entry.older;
+	else if (_newest == int(slot))
+		_newest = entry.older;
+	if (entry.older >= 0)
+		_entries[entry.older].newer = entry.newer;
+	else if (_oldest == int(slot))
+		_oldest = entry.newer;
+	entry.newer = entry.older = -1;
+	}
+
+// Moves a resident tile to the front of the least recently used list
+void TileLoader::touch(uint32_t slot)
+	{
+	if (_newest == int(slot))
+		return;
+	unlink(slot);
+	auto &entry = _entries[slot];
+	entry.older = _newest;
+	if (_newest >= 0)
+		_entries[_newest].newer = int(slot);
+	_newest = int(slot);
+	if (_oldest < 0)
+		_oldest = int(slot);
+	}
+
+// Least recently used first, down to the budget; the tiles this frame has
+// used are the newest, and stay even if that leaves it over. Unloading
+// under the lock keeps a tile asked for again from loading before its old
+// pages are dropped.
+void TileLoader::evict()
+	{
+	while (_stats.residentBytes > _budgetBytes && _oldest >= 0 && _entries[_oldest].frame != _frame)
+		{
+		auto slot = uint32_t(_oldest);
+		unlink(slot);
+		_source->unload(_entries[slot].key);
+		_stats.residentBytes -= _entries[slot].bytes;
+		--_stats.resident;
+		++_stats.evicted;
+		release(slot);
+		}
+	}
+
+// Loads run outside the lock, the entry is marked Loading so nothing else
+// takes it meanwhile
+void TileLoader::ioLoop(int index)
+	{
+	TraceRecorder::setThreadName("loader " + std::to_string(index));
+
+	std::unique_lock<std::mutex> lock(_lock);
+	for (;;)
+		{
+		_work.wait(lock, [this] { return _quit || !_queue.empty(); });
+		if (_quit)
+			return;
+
+		auto slot = _queue.top().slot;
+		_queue.pop();
+		auto key = _entries[slot].key;
+		_entries[slot].state = State::Loading;
+		++_stats.loading;
+
+		lock.unlock();
+		size_t bytes;
+			{
+			TraceScope scope("load", "loader");
+			bytes = _source->load(key);
+			}
+		lock.lock();
+
+		--_stats.loading;
+		auto &entry = _entries[slot];
+		if (!bytes)
+			{
+			entry.state = State::Failed;
+			++_stats.failed;
+			continue;
+			}
+
+		entry.state = State::Resident;
+		entry.bytes = bytes;
+		touch(slot);
+		_stats.residentBytes += bytes;
+		++_stats.resident;
+		++_stats.loaded;
+		_arrived = true;
+		evict();
+		}
+	}
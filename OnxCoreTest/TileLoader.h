@@ -0,0 +1,138 @@
+#pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "PersistentQuadtree.h"
+#include "TileKeyMap.h"
+#include "TilePyramid.h"
+
+constexpr int DEFAULT_LOAD_BUDGET_MB = 64;
+constexpr int DEFAULT_LOAD_THREADS = 2;
+
+// Where tiles come from, a file or a tile service. load is called on the
+// loader's I/O threads, several at once, and makes the tile readable where
+// the traversal and renderer read it; unload gives its memory back when
+// the loader evicts it. The loader only keeps track of which tiles are
+// resident, and how many bytes they hold.
+class TileSource
+{
+public:
+	virtual ~TileSource() {}
+	// Depths with tiles of their own; deeper tiles draw with their
+	// finest ancestor's
+	virtual int levels() const = 0;
+	// The bytes the tile holds now it's readable, 0 if it can't be loaded
+	virtual size_t load(uint64_t key) const = 0;
+	virtual void unload(uint64_t key) const = 0;
+};
+
+// Stand-in for a local tile service: reads a tile's block of a pyramid file
+// into its mapping, after a fixed delay standing in for the round trip, so
+// the pyramid's readers find it in memory, and drops the block's pages
+// again when it's unloaded
+class PyramidTileSource : public TileSource
+{
+public:
+	explicit PyramidTileSource(std::shared_ptr<TilePyramid const> pyramid, int latencyMicroseconds = 0);
+
+	int levels() const override { return _pyramid->levels(); }
+	size_t load(uint64_t key) const override;
+	void unload(uint64_t key) const override;
+
+private:
+	std::shared_ptr<TilePyramid const> _pyramid;
+	int _latencyMicroseconds;
+};
+
+struct LoaderStats
+	{
+	int queued;				// waiting for an I/O thread
+	int loading;
+	int resident;
+	size_t residentBytes;
+	long long loaded,		// totals since the loader started
+		cancelled,
+		evicted,
+		failed;
+	};
+
+// Loads tiles off the frame: the traversal asks for the tiles it
+// would like to refine into, a few I/O threads load them highest screen
+// space error first, and loaded tiles stay resident in a least recently
+// used cache up to a byte budget. Requests have to be repeated every frame
+// they're still wanted; the ones a frame didn't repeat have fallen out of
+// view and are dropped before they're loaded. Nothing here waits on a
+// load, the traversal draws what's resident and comes back for the rest.
+class TileLoader
+{
+public:
+	TileLoader(std::shared_ptr<TileSource const> source, size_t budgetBytes, int threads);
+	~TileLoader();
+
+	int levels() const { return _source->levels(); }
+
+	void beginFrame();
+	void request(uint64_t key, float priority);
+	bool resident(uint64_t key);
+	bool residentOrRequest(uint64_t const *keys, int count, float priority);
+	void endFrame();
+
+	bool takeArrivals();
+	LoaderStats stats() const;
+
+private:
+	enum class State : uint8_t
+		{
+		Free,
+		Queued,
+		Loading,
+		Resident,
+		Failed		// kept so it isn't asked for again
+		};
+
+	struct Entry
+		{
+		uint64_t key;
+		State state;
+		float priority;
+		uint32_t frame;		// last frame it was requested or used
+		int newer, older;	// least recently used list of resident tiles, -1 at the ends
+		size_t bytes;		// while resident
+		};
+
+	struct Ranked
+		{
+		float priority;
+		uint32_t slot;
+		bool operator<(Ranked const &other) const { return priority < other.priority; }
+		};
+
+	std::shared_ptr<TileSource const> _source;
+	size_t _budgetBytes;
+
+	mutable std::mutex _lock;
+	std::condition_variable _work;
+	std::vector<std::thread> _threads;
+	bool _quit = false;
+
+	std::vector<Entry> _entries;
+	std::vector<uint32_t> _freeSlots;
+	TileKeyMap _slotOfKey;
+	ReusableQueue<Ranked> _queue;	// rebuilt from the requests at the end of every frame
+	int _newest = -1,
+		_oldest = -1;
+	uint32_t _frame = 0;
+	bool _arrived = false;
+	LoaderStats _stats = {};
+
+	uint32_t allocate(uint64_t key);
+	void release(uint32_t slot);
+	bool use(uint64_t key);
+	void queue(uint64_t key, float priority);
+	void unlink(uint32_t slot);
+	void touch(uint32_t slot);
+	void evict();
+	void ioLoop(int index);
+};
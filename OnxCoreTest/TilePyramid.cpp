@@ -0,0 +1,216 @@
+#include "TilePyramid.h"
+#include <algorithm>
+#include <gtc/bitfield.hpp>
+
+namespace
+	{
+	// Far more than any tile wants, it only keeps a corrupt header from
+	// overflowing the size checks
+	constexpr uint32_t MAX_PYRAMID_TILE_CELLS = 4096;
+
+	uint64_t wholePages(uint64_t bytes)
+		{
+		return (bytes + PYRAMID_PAGE_SIZE - 1) / PYRAMID_PAGE_SIZE * PYRAMID_PAGE_SIZE;
+		}
+	}
+
+PyramidHeader makePyramidHeader(int levels, int tileCells)
+	{
+	PyramidHeader header = {};
+	header.Magic = PYRAMID_MAGIC;
+	header.Version = PYRAMID_VERSION;
+	header.Levels = uint32_t(levels);
+	header.TileCells = uint32_t(tileCells);
+	header.TableOffset = sizeof(PyramidHeader);
+	header.BlockBytes = wholePages(uint64_t(tileCells + 1) * uint64_t(tileCells + 1) * sizeof(float) +
+		pyramidPartCount(tileCells) * sizeof(glm::vec2));
+
+	auto tiles = pyramidTileCount(levels);
+	header.FileBytes = wholePages(header.TableOffset + tiles * sizeof(PyramidEntry)) + tiles * header.BlockBytes;
+	return header;
+	}
+
+// 1 + 4 + 16 + ... for depths 0 to levels - 1
+uint64_t pyramidTileCount(int levels)
+	{
+	return ((uint64_t(1) << (2 * levels)) - 1) / 3;
+	}
+
+uint64_t pyramidEntryIndex(glm::uvec2 const &cell, int depth)
+	{
+	return pyramidTileCount(depth) + glm::bitfieldInterleave(cell.x, cell.y);
+	}
+
+int pyramidPartLevels(int tileCells)
+	{
+	int levels = 0;
+	while (tileCells >> (levels + 1) > PYRAMID_SCAN_CELLS)
+		++levels;
+	return levels;
+	}
+
+// 4 + 16 + ... for levels 1 to pyramidPartLevels
+uint64_t pyramidPartCount(int tileCells)
+	{
+	return pyramidPartIndex(glm::uvec2(0), pyramidPartLevels(tileCells) + 1);
+	}
+
+uint64_t pyramidPartIndex(glm::uvec2 const &part, int level)
+	{
+	return ((uint64_t(1) << (2 * level)) - 4) / 3 + (uint64_t(part.y) << level) + part.x;
+	}
+
+glm::uvec2 pyramidPartSamples(unsigned part, int level, int tileCells)
+	{
+	auto parts = uint64_t(1) << level;
+	return glm::uvec2(unsigned(part * uint64_t(tileCells) / parts),
+		unsigned(((part + 1) * uint64_t(tileCells) + parts - 1) / parts));
+	}
+
+bool TilePyramid::open(char const *path)
+	{
+	_header = nullptr;
+	_table = nullptr;
+	if (!_file.openRead(path) || _file.size() < sizeof(PyramidHeader))
+		{
+		_file.close();
+		return false;
+		}
+
+	auto header = reinterpret_cast<PyramidHeader const *>(_file.data());
+	auto tiles = pyramidTileCount(int(std::min<uint32_t>(header->Levels, MAX_PYRAMID_LEVELS)));
+	bool valid = header->Magic == PYRAMID_MAGIC &&
+		header->Version == PYRAMID_VERSION &&
+		header->Levels >= 1 && header->Levels <= MAX_PYRAMID_LEVELS &&
+		header->TileCells >= 1 && header->TileCells <= MAX_PYRAMID_TILE_CELLS &&
+		header->BlockBytes >= uint64_t(header->TileCells + 1) * (header->TileCells + 1) * sizeof(float) +
+			pyramidPartCount(int(header->TileCells)) * sizeof(glm::vec2) &&
+		header->FileBytes == _file.size() &&
+		header->TableOffset % alignof(PyramidEntry) == 0 &&
+		header->TableOffset <= _file.size() &&
+		tiles <= (_file.size() - header->TableOffset) / sizeof(PyramidEntry);
+
+	// every block has to be inside the file, and aligned for its floats
+	auto table = reinterpret_cast<PyramidEntry const *>(_file.data() + header->TableOffset);
+	for (uint64_t tile = 0; valid && tile < tiles; ++tile)
+		valid = table[tile].Offset % alignof(float) == 0 &&
+			table[tile].Offset <= _file.size() &&
+			header->BlockBytes <= _file.size() - table[tile].Offset;
+
+	if (!valid)
+		{
+		_file.close();
+		return false;
+		}
+
+	_header = header;
+	_table = table;
+	_prefetched.reset(new std::atomic<bool>[tiles]());
+	return true;
+	}
+
+int TilePyramid::depthForCells(int cells) const
+	{
+	for (int depth = 0; depth < levels(); ++depth)
+		if (int64_t(tileCells()) << depth >= cells)
+			return depth;
+	return levels() - 1;
+	}
+
+uint64_t TilePyramid::entryIndex(glm::uvec2 cell, int depth) const
+	{
+	if (depth >= levels())
+		{
+		cell >>= unsigned(depth - (levels() - 1));
+		depth = levels() - 1;
+		}
+	return pyramidEntryIndex(cell, depth);
+	}
+
+float const *TilePyramid::heights(glm::uvec2 const &cell, int depth) const
+	{
+	return reinterpret_cast<float const *>(_file.data() + _table[entryIndex(cell, depth)].Offset);
+	}
+
+size_t TilePyramid::load(glm::uvec2 const &cell, int depth) const
+	{
+	auto index = entryIndex(cell, depth);
+	_file.touch(size_t(_table[index].Offset), size_t(_header->BlockBytes));
+	return size_t(_header->BlockBytes);
+	}
+
+void TilePyramid::unload(glm::uvec2 const &cell, int depth) const
+	{
+	_file.release(size_t(_table[entryIndex(cell, depth)].Offset), size_t(_header->BlockBytes));
+	}
+
+glm::vec2 const *TilePyramid::partRanges(glm::uvec2 const &cell, int depth) const
+	{
+	return reinterpret_cast<glm::vec2 const *>(heights(cell, depth) + size_t(samplesPerSide()) * samplesPerSide());
+	}
+
+float TilePyramid::height(glm::vec2 const &p, int depth) const
+	{
+	depth = std::min(std::max(depth, 0), levels() - 1);
+	auto tiles = float(1u << depth);
+	auto grid = glm::clamp((p + ROOT_HALF_SIZE) * (tiles / (2.f * ROOT_HALF_SIZE)), glm::vec2(0.f), glm::vec2(tiles));
+	auto cell = glm::min(glm::uvec2(grid), glm::uvec2((1u << depth) - 1));
+
+	auto local = (grid - glm::vec2(cell)) * float(tileCells());
+	auto sample = glm::min(glm::ivec2(local), glm::ivec2(tileCells() - 1));
+	auto t = local - glm::vec2(sample);
+
+	auto corner = heights(cell, depth) + size_t(sample.y) * samplesPerSide() + sample.x;
+	auto bottom = glm::mix(corner[0], corner[1], t.x),
+		top = glm::mix(corner[samplesPerSide()], corner[samplesPerSide() + 1], t.x);
+	return glm::mix(bottom, top, t.y);
+	}
+
+// From the table down to the finest depth. Below it a node covers a part of
+// a finest tile, whose range is stored while the part is large and found
+// from its few samples after that; both bound the bilinear surface.
+glm::vec2 TilePyramid::range(glm::uvec2 const &cell, int depth) const
+	{
+	if (depth < levels())
+		{
+		auto &entry = _table[entryIndex(cell, depth)];
+		return glm::vec2(entry.Min, entry.Max);
+		}
+
+	auto below = depth - (levels() - 1);
+	auto part = cell & ((1u << below) - 1);
+	if (below <= pyramidPartLevels(tileCells()))
+		return partRanges(cell, depth)[pyramidPartIndex(part, below)];
+
+	auto columns = pyramidPartSamples(part.x, below, tileCells()),
+		rows = pyramidPartSamples(part.y, below, tileCells());
+	auto samples = heights(cell, depth);
+	auto lo = samples[size_t(rows.x) * samplesPerSide() + columns.x],
+		hi = lo;
+	for (auto y = rows.x; y <= rows.y; ++y)
+		{
+		auto row = samples + size_t(y) * samplesPerSide();
+		for (auto x = columns.x; x <= columns.y; ++x)
+			{
+			lo = std::min(lo, row[x]);
+			hi = std::max(hi, row[x]);
+			}
+		}
+	return glm::vec2(lo, hi);
+	}
+
+void TilePyramid::prefetch(glm::uvec2 const &cell, int depth, bool refining) const
+	{
+	prefetchBlock(entryIndex(cell, depth));
+	if (refining && depth + 1 < levels())
+		for (unsigned child = 0; child < 4; ++child)
+			prefetchBlock(entryIndex(cell * 2u + glm::uvec2(child & 1, child >> 1), depth + 1));
+	}
+
+void TilePyramid::prefetchBlock(uint64_t index) const
+	{
+	auto &prefetched = _prefetched[index];
+	if (prefetched.load(std::memory_order_relaxed) || prefetched.exchange(true, std::memory_order_relaxed))
+		return;
+	_file.willNeed(size_t(_table[index].Offset), size_t(_header->BlockBytes));
+	}
@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "Heightfield.h"
+#include "MappedFile.h"
+
+// Terrain too big for memory, in one file that's mapped rather than read:
+//
+//   PyramidHeader                 at 0
+//   PyramidEntry table            one per tile, depth 0's, then depth 1's
+//                                 and so on, each depth's in the quadkey
+//                                 (Morton) order of its cells
+//   tile blocks                   one per tile, page aligned and padded to
+//                                 whole pages: (TileCells + 1)^2 floats,
+//                                 rows of increasing y, the edge samples
+//                                 repeated in the neighbouring tiles; then
+//                                 room for the part ranges below
+//
+// The finest depth samples the full resolution grid, every depth above
+// averages the one below it (see OnxPyramidBuilder), so each depth is the
+// same surface drawn more coarsely. The table gives each tile's elevation
+// range over the full resolution surface, so culling reads only the table
+// and a tile's block is only paged in when its samples are wanted.
+//
+// Nodes deeper than the pyramid cover a part of a finest tile, so the
+// finest tiles' blocks also hold the ranges of their parts: min, max pairs
+// for the 2x2 parts of the tile, then the 4x4 parts and so on, rows of
+// increasing y, for as long as a part is more than PYRAMID_SCAN_CELLS cells
+// across. Smaller parts are few enough samples to scan. Coarser tiles leave
+// that space zeroed. Little endian throughout; written by OnxPyramidBuilder.
+constexpr uint32_t PYRAMID_MAGIC = 0x50584e4f;	// "ONXP"
+constexpr uint32_t PYRAMID_VERSION = 2;
+constexpr uint64_t PYRAMID_PAGE_SIZE = 4096;
+constexpr int DEFAULT_PYRAMID_TILE_CELLS = 64;
+constexpr int MAX_PYRAMID_LEVELS = 16;
+constexpr int PYRAMID_SCAN_CELLS = 8;
+
+struct PyramidHeader
+	{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t Levels;		// depths 0 to Levels - 1
+	uint32_t TileCells;		// cells a side of every tile
+	uint64_t TableOffset;
+	uint64_t BlockBytes;	// per tile, whole pages
+	uint64_t FileBytes;
+	};
+
+struct PyramidEntry
+	{
+	uint64_t Offset;	// of the tile's block
+	float Min;
+	float Max;
+	};
+
+static_assert(sizeof(PyramidHeader) == 40 && sizeof(PyramidEntry) == 16, "the pyramid file layout is fixed");
+
+// Header of a pyramid with the tables and blocks laid out one after another
+PyramidHeader makePyramidHeader(int levels, int tileCells);
+uint64_t pyramidTileCount(int levels);
+// Index into the table of the tile at cell, depth
+uint64_t pyramidEntryIndex(glm::uvec2 const &cell, int depth);
+// How many levels of part ranges a finest tile stores, and how many ranges
+// that is altogether
+int pyramidPartLevels(int tileCells);
+uint64_t pyramidPartCount(int tileCells);
+// Index among the part ranges of part at level (1 for the 2x2 parts)
+uint64_t pyramidPartIndex(glm::uvec2 const &part, int level);
+// First and last sample along either axis of the tile that a part covers;
+// rounded outwards when the tile's cells don't divide evenly, which nests,
+// so each part's samples are the union of its four subparts'
+glm::uvec2 pyramidPartSamples(unsigned part, int level, int tileCells);
+
+// A pyramid file mapped read only; the tile blocks are read in place. Nodes
+// deeper than the pyramid use the finest tile they're in, and the range of
+// the part of it they cover.
+class TilePyramid : public ElevationBounds
+{
+public:
+	bool open(char const *path);	// false if it can't be mapped or isn't a valid pyramid
+
+	int levels() const { return int(_header->Levels); }
+	int tileCells() const { return int(_header->TileCells); }
+	int samplesPerSide() const { return tileCells() + 1; }
+	// The shallowest depth whose tiles have at least this many cells
+	// across the root between them, or the finest
+	int depthForCells(int cells) const;
+
+	// samplesPerSide()^2 heights, straight out of the mapping
+	float const *heights(glm::uvec2 const &cell, int depth) const;
+	// pyramidPartCount() min, max pairs after them, in the finest tiles
+	glm::vec2 const *partRanges(glm::uvec2 const &cell, int depth) const;
+	// Bilinear in the tile at depth containing p, clamped to the root quad
+	float height(glm::vec2 const &p, int depth) const;
+
+	// Reads the tile's block in now, rather than on first use, and returns
+	// its size
+	size_t load(glm::uvec2 const &cell, int depth) const;
+	// Drops the block's pages, reading it again faults them back in
+	void unload(glm::uvec2 const &cell, int depth) const;
+
+	glm::vec2 range(glm::uvec2 const &cell, int depth) const override;
+	void prefetch(glm::uvec2 const &cell, int depth, bool refining) const override;
+
+private:
+	MappedFile _file;
+	PyramidHeader const *_header = nullptr;
+	PyramidEntry const *_table = nullptr;
+	// per tile, set once its block has been asked for, so the traversal
+	// only costs a system call the first time
+	std::unique_ptr<std::atomic<bool>[]> _prefetched;
+
+	uint64_t entryIndex(glm::uvec2 cell, int depth) const;
+	void prefetchBlock(uint64_t index) const;
+};
+
+// One depth of a pyramid as a HeightfieldProvider, so a Heightfield for the
+// renderer can be sampled from it while only reading that depth's blocks
+class PyramidLevel : public HeightfieldProvider
+{
+public:
+	PyramidLevel(TilePyramid const &pyramid, int depth) : _pyramid(pyramid), _depth(depth) {}
+	float elevation(glm::vec2 const &p) const override { return _pyramid.height(p, _depth); }
+
+private:
+	TilePyramid const &_pyramid;
+	int _depth;
+};
@@ -0,0 +1,416 @@
+#include "TileRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+#include <gtc/type_ptr.hpp>
+#include <vector>
+#include <array>
+#include <cstddef>
+
+using namespace std;
+
+TileRenderer::TileRenderer(std::string const &resourcePath) :
+	  mColorShader((GLuint)-1)
+	, mColorLoc((GLuint)-1)
+	, mTileShader((GLuint)-1)
+	, _resourcePath(resourcePath)
+{
+	GLint profile = 0;
+	glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+	_coreProfile = (profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+
+	////setup the shader
+	auto vertPath = _resourcePath + "colorVertShader.txt",
+		pixelPath = _resourcePath + "colorPixelShader.txt";
+	mColorShader = setupShader(&vertPath[0], &pixelPath[0]);
+	mColorLoc = glGetUniformLocation(mColorShader, "Color");
+	mColorViewProjLoc = glGetUniformLocation(mColorShader, "ViewProj");
+
+	// The debug camera's triangle, rewritten whenever it's drawn; without
+	// vertex array objects it's drawn immediate mode like the tiles
+	_vertexArrays = hasVertexArrays();
+	if (_vertexArrays)
+		{
+		glGenVertexArrays(1, &mDebugVertexArray);
+		glBindVertexArray(mDebugVertexArray);
+		glGenBuffers(1, &mDebugBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, mDebugBuffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+	setupTileBuffers();
+}
+
+TileRenderer::~TileRenderer(void)
+{
+	if (mHeightTexture)
+		glDeleteTextures(1, &mHeightTexture);
+	if (mTileShader != (GLuint)-1)
+		{
+		glDeleteVertexArrays(1, &mTileVertexArray);
+		glDeleteBuffers(1, &mQuadBuffer);
+		glDeleteProgram(mTileShader);
+		}
+	if (mDebugVertexArray)
+		{
+		glDeleteVertexArrays(1, &mDebugVertexArray);
+		glDeleteBuffers(1, &mDebugBuffer);
+		}
+	glDeleteProgram(mColorShader);
+}
+
+// Builds the instanced tile path: a unit quad shared by every tile, and
+// TileInstance records, in _tileSlots or streamed through _instanceStream,
+// that the vertex shader stretches it over. If the shaders don't link (no
+// GL 3.3) tiles are drawn immediate mode instead
+void TileRenderer::setupTileBuffers()
+	{
+	auto vertPath = _resourcePath + "tileVertShader.txt",
+		pixelPath = _resourcePath + "tilePixelShader.txt";
+	mTileShader = setupShader(&vertPath[0], &pixelPath[0]);
+	GLint linked = GL_FALSE;
+	if (mTileShader != (GLuint)-1)
+		glGetProgramiv(mTileShader, GL_LINK_STATUS, &linked);
+	if (!linked)
+		{
+		cout << "instanced tile shaders unavailable, drawing tiles immediate mode\n";
+		if (mTileShader != (GLuint)-1)
+			glDeleteProgram(mTileShader);
+		mTileShader = (GLuint)-1;
+		_renderMode = RenderMode::Immediate;
+		return;
+		}
+
+	mTileViewProjLoc = glGetUniformLocation(mTileShader, "ViewProj");
+	mTileHeightSamplesLoc = glGetUniformLocation(mTileShader, "HeightSamples");
+	_glState.useProgram(mTileShader);
+	glUniform1i(glGetUniformLocation(mTileShader, "Heights"), 0);
+	glUniform1f(mTileHeightSamplesLoc, 0.f);
+
+	// Corners in triangle strip order
+	static const float quad[] = { 0, 0,  1, 0,  0, 1,  1, 1 };
+
+	glGenVertexArrays(1, &mTileVertexArray);
+	glBindVertexArray(mTileVertexArray);
+
+	glGenBuffers(1, &mQuadBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+// Immediate mode isn't available in a core profile context
+void TileRenderer::setRenderMode(RenderMode mode)
+	{
+	if (mTileShader != (GLuint)-1 && !(mode == RenderMode::Immediate && _coreProfile))
+		_renderMode = mode;
+	}
+
+// Draws the tiles raised onto the heightfield, or flat again with null. The
+// instanced shader reads the samples from a texture, bilinear filtering
+// giving the same surface Heightfield::height does.
+void TileRenderer::setHeightfield(std::shared_ptr<Heightfield const> heightfield)
+	{
+	_heightfield = std::move(heightfield);
+	if (mTileShader == (GLuint)-1)
+		return;
+
+	_glState.useProgram(mTileShader);
+	if (!_heightfield)
+		{
+		if (mHeightTexture)
+			glDeleteTextures(1, &mHeightTexture);
+		mHeightTexture = 0;
+		glUniform1f(mTileHeightSamplesLoc, 0.f);
+		return;
+		}
+
+	if (!mHeightTexture)
+		glGenTextures(1, &mHeightTexture);
+	auto side = _heightfield->samplesPerSide();
+	glBindTexture(GL_TEXTURE_2D, mHeightTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, side, side, 0, GL_RED, GL_FLOAT, _heightfield->samples().data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUniform1f(mTileHeightSamplesLoc, float(side));
+	}
+
+// The original path, a uniform and a glBegin/glEnd per tile; kept for
+// comparison and for compatibility contexts without instancing
+void TileRenderer::drawTilesImmediate(TileList const &tiles)
+	{
+	_glState.useProgram(mColorShader);
+	if (_vertexArrays)
+		_glState.bindVertexArray(0);
+
+	for (auto &quad : tiles)
+		{
+		auto color = quad.Color();
+		auto p1 = quad.P1(),
+			p2 = quad.P2();
+		glUniform4f(mColorLoc, color.r, color.g, color.b, color.a);
+
+		auto height = [this](float x, float y) { return _heightfield ? _heightfield->height(glm::vec2(x, y)) : 0.f; };
+		glBegin(GL_QUADS);
+		glVertex3f(p1.x,	p1.y, height(p1.x, p1.y));
+		glVertex3f(p2.x,	p1.y, height(p2.x, p1.y));
+		glVertex3f(p2.x,	p2.y, height(p2.x, p2.y));
+		glVertex3f(p1.x,	p2.y, height(p1.x, p2.y));
+		glEnd();
+		}
+	}
+
+// Writes one TileInstance per tile straight into the mapped stream region
+// and draws them all with a single call
+void TileRenderer::drawTilesInstanced(TileList const &tiles)
+	{
+	if (tiles.empty())
+		return;
+
+	_instanceStream.reserve(tiles.size());
+	auto instances = (TileInstance*)_instanceStream.map(tiles.size());
+	for (auto &tile : tiles)
+		{
+		instances->KeyLow = uint32_t(tile.Key);
+		instances->KeyHigh = uint32_t(tile.Key >> 32);
+		instances->PackedColor = tile.PackedColor;
+		++instances;
+		}
+	_instanceStream.unmap();
+
+	auto offset = _instanceStream.offset();
+	drawInstances(_instanceStream.buffer(),
+		offset + offsetof(TileInstance, KeyLow), offset + offsetof(TileInstance, PackedColor), sizeof(TileInstance),
+		tiles.size());
+	_instanceStream.fence();
+	}
+
+// Updates only the slots whose tiles changed and draws every slot, the
+// retired ones come out empty
+void TileRenderer::drawTilesDelta(TileList const &tiles)
+	{
+	_tileSlots.update(tiles);
+	if (_tileSlots.slotCount() > 0)
+		drawInstances(_tileSlots.buffer(), _tileSlots.keyOffset(), _tileSlots.colorOffset(), 0, _tileSlots.slotCount());
+	}
+
+// The instances move between buffers, stream regions and layouts, so the
+// instance attributes are pointed at them every draw rather than once in
+// setupTileBuffers. A stride of 0 means keys and colours are each tightly
+// packed arrays.
+void TileRenderer::drawInstances(GLuint buffer, size_t keyOffset, size_t colorOffset, GLsizei stride, size_t count)
+	{
+	_glState.useProgram(mTileShader);
+	_glState.bindVertexArray(mTileVertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribIPointer(1, 2, GL_UNSIGNED_INT, stride, (void*)keyOffset);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)colorOffset);
+	if (mHeightTexture)
+		{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, mHeightTexture);
+		}
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(count));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+// Point the shaders at a fixed location to see the results of
+// the tile generation/culling algorithm, disables front/backface 
+// culling, and sets fill mode to wireframe
+void TileRenderer::setDebugCamera()
+	{
+	auto mPosition = glm::vec3(10, 0, 10);
+	auto mLookPoint = glm::vec3(0, 0, 0);
+
+	//depth test on
+	_glState.enable(GL_DEPTH_TEST, true);
+	_glState.enable(GL_CULL_FACE, false);
+	_glState.polygonMode(GL_LINE);
+
+	//projection rendering
+	float angle = 45.0f;
+	float ratio = 1280.0f / 720.0f;
+	float nearPlane = 1.0f;
+	float farPlane = 100.0f;
+	setViewProj(glm::perspective(glm::radians(angle), ratio, nearPlane, farPlane) *
+		glm::lookAt(mPosition, mLookPoint, glm::vec3(0, 0, 1)));
+	}
+
+// Point the shaders at the orbit camera's location, disables
+// front/backface culling, and sets the fill mode to solid
+void TileRenderer::setDeviceCamera(OrbitCamera const &camera)
+	{
+	//depth test on
+	_glState.enable(GL_DEPTH_TEST, true);
+	_glState.enable(GL_CULL_FACE, false);
+	_glState.polygonMode(GL_FILL);
+
+	setViewProj(camera.deviceViewProj());
+	}
+
+// Hands both shaders the camera matrix, only when it has changed
+void TileRenderer::setViewProj(glm::mat4x4 const &viewProj)
+	{
+	if (_viewProjUploaded && viewProj == _viewProj)
+		return;
+
+	_viewProj = viewProj;
+	_viewProjUploaded = true;
+	_glState.useProgram(mColorShader);
+	glUniformMatrix4fv(mColorViewProjLoc, 1, GL_FALSE, glm::value_ptr(viewProj));
+	if (mTileShader != (GLuint)-1)
+		{
+		_glState.useProgram(mTileShader);
+		glUniformMatrix4fv(mTileViewProjLoc, 1, GL_FALSE, glm::value_ptr(viewProj));
+		}
+	}
+
+// Draws a frame of tiles into the current framebuffer, seen from the
+// camera or, with debugCamera, from the fixed debug viewpoint with the
+// camera drawn in as a triangle
+void TileRenderer::render(TileList const &tiles, OrbitCamera const &camera, bool debugCamera)
+{
+		{
+		ProfileScope scope(_profiler, FramePhase::CameraSetup);
+		if (!debugCamera)
+			setDeviceCamera(camera);
+		else
+			setDebugCamera();
+
+		//clear to black
+		glClearColor(0,0,0,0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+
+	ProfileScope scope(_profiler, FramePhase::DrawSubmit);
+	if (_renderMode == RenderMode::DeltaInstanced)
+		drawTilesDelta(tiles);
+	else if (_renderMode == RenderMode::Instanced)
+		drawTilesInstanced(tiles);
+	else
+		drawTilesImmediate(tiles);
+
+	if (debugCamera)
+		{
+		auto &position = camera.position(),
+			&focus = camera.focus();
+		glm::vec3 triangle[] = { position, focus, glm::vec3(position.x, position.y, 0) };
+
+		_glState.useProgram(mColorShader);
+		glUniform4f(mColorLoc, 0, 1, 0, 1);
+		if (mDebugVertexArray)
+			{
+			_glState.bindVertexArray(mDebugVertexArray);
+			glBindBuffer(GL_ARRAY_BUFFER, mDebugBuffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STREAM_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			}
+		else
+			{
+			glBegin(GL_TRIANGLES);
+			for (auto &vertex : triangle)
+				glVertex3f(vertex.x, vertex.y, vertex.z);
+			glEnd();
+			}
+		}
+}
+
+// Over whatever render drew, in one draw call
+void TileRenderer::drawProfileOverlay(FrameProfile const &profile)
+	{
+	if (!_overlay)
+		{
+		auto vertPath = _resourcePath + "overlayVertShader.txt",
+			pixelPath = _resourcePath + "overlayPixelShader.txt";
+		_overlay.reset(new ProfilerOverlay(setupShader(&vertPath[0], &pixelPath[0])));
+		}
+	_overlay->draw(profile, _glState);
+	}
+
+//load and compile the shaders
+GLuint TileRenderer::setupShader(char* vertPath, char* pixelPath)
+{
+	ifstream vertFile(vertPath);
+	if(!vertFile)
+	{
+		cout << "could not read vert file " <<  vertPath;
+		return (GLuint)-1;
+	}
+	stringstream  vertBuffer;
+	vertBuffer << vertFile.rdbuf();
+	string vs = vertBuffer.str();
+	vertShaderText = &vs[0u];
+	vertFile.close();
+	vertBuffer.clear();
+
+	//compile vert shader
+	GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertShader, 1, &vertShaderText, NULL);
+	glCompileShader(vertShader);
+
+	GLint succeeded;
+	glGetShaderiv(vertShader, GL_COMPILE_STATUS, &succeeded);
+	if(!succeeded)
+	{
+		GLchar log[1024];
+		glGetShaderInfoLog(vertShader, 1024, NULL, log);
+		cout << "Vert shader " << vertPath << ":\n" << log;
+	}
+
+	ifstream pixelFile(pixelPath);
+	if(!pixelFile)
+	{
+		cout << "could not read pixel file " << pixelPath;
+		return (GLuint)-1;
+	}
+
+	stringstream pixelBuffer;
+	pixelBuffer << pixelFile.rdbuf();
+	string ps = pixelBuffer.str();
+	pixelShaderText = &ps[0u];
+	pixelFile.close();
+	pixelBuffer.clear();
+
+	//compile pixel shader
+	GLuint pixelShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(pixelShader, 1, &pixelShaderText, NULL);
+	glCompileShader(pixelShader);
+
+	succeeded;
+	glGetShaderiv(pixelShader, GL_COMPILE_STATUS, &succeeded);
+	if(!succeeded)
+	{
+		GLchar log[1024];
+		glGetShaderInfoLog(pixelShader, 1024, NULL, log);
+		cout << "Pixel shader " << pixelPath << ":\n" <<log;
+	}
+
+	//link it all together
+	GLuint shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, vertShader);
+	glAttachShader(shaderProgram, pixelShader);
+	glLinkProgram(shaderProgram);
+
+	//cleanup
+	glDeleteShader(vertShader);
+	glDeleteShader(pixelShader);
+
+	return shaderProgram;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "FrameProfiler.h"
+#include "GLPlatform.h"
+#include "GLStateCache.h"
+#include "Heightfield.h"
+#include "OrbitCamera.h"
+#include "ProfilerOverlay.h"
+#include "StreamBuffer.h"
+#include "TileSlotBuffer.h"
+#include "Types.h"
+
+// How tiles are submitted: one instanced draw over TileInstance records
+// streamed in full every frame or kept in slots and only updated where the
+// tiles changed, or the original glBegin/glEnd per tile
+enum class RenderMode
+	{
+	Instanced,
+	DeltaInstanced,
+	Immediate
+	};
+
+// Per tile vertex data for the instanced path: the tile's key split into
+// two words and its colour, the shader decodes the corners from the key
+struct TileInstance
+	{
+	uint32_t KeyLow;
+	uint32_t KeyHigh;
+	uint32_t PackedColor;	// RGBA8, see packTileColor
+	};
+
+static_assert(sizeof(TileInstance) == 12, "TileInstance is streamed every frame, keep it packed");
+
+// Draws tiles with whatever GL context is current; owns the shaders and
+// buffers but no window, so a GLUT window and an offscreen context can
+// both drive it
+class TileRenderer
+{
+
+public:
+	explicit TileRenderer(std::string const &resourcePath = "Resources/");
+	~TileRenderer(void);
+	void render(TileList const &tiles, OrbitCamera const &camera, bool debugCamera);
+	GLuint setupShader(char* vertPath, char* pixelPath);
+	void setRenderMode(RenderMode mode);
+	void setHeightfield(std::shared_ptr<Heightfield const> heightfield);
+	void setProfiler(FrameProfiler *profiler) { _profiler = profiler; }
+	void drawProfileOverlay(FrameProfile const &profile);
+	StreamStats const &streamStats() const { return _instanceStream.stats(); }
+	SlotStats const &slotStats() const { return _tileSlots.stats(); }
+private:
+	char* vertShaderText;
+	char* pixelShaderText;
+	GLuint mColorShader;
+	GLint mColorLoc;
+	GLint mColorViewProjLoc;
+	GLuint mDebugVertexArray = 0,	// 0 without vertex array objects
+		mDebugBuffer = 0;
+	bool _vertexArrays = false;		// GL 3.0 or ARB_vertex_array_object
+	GLuint mTileShader;
+	GLint mTileViewProjLoc = -1,
+		mTileHeightSamplesLoc = -1;
+	GLuint mHeightTexture = 0;	// the heightfield's samples, 0 when flat
+	GLuint mTileVertexArray = 0,
+		mQuadBuffer = 0;
+	std::string _resourcePath;
+	RenderMode _renderMode = RenderMode::Instanced;
+	StreamBuffer _instanceStream { sizeof(TileInstance) };
+	TileSlotBuffer _tileSlots;
+	GLStateCache _glState;
+	FrameProfiler *_profiler = nullptr;	// times the camera setup and draw phases when set
+	std::unique_ptr<ProfilerOverlay> _overlay;	// built on first use
+	std::shared_ptr<Heightfield const> _heightfield;	// null for the flat quad
+	bool _coreProfile = false;
+	glm::mat4x4 _viewProj;	// last uploaded to the shaders
+	bool _viewProjUploaded = false;
+
+	void setDeviceCamera(OrbitCamera const &camera);
+	void setDebugCamera();
+	void setViewProj(glm::mat4x4 const &viewProj);
+	void setupTileBuffers();
+	void drawTilesImmediate(TileList const &tiles);
+	void drawTilesInstanced(TileList const &tiles);
+	void drawTilesDelta(TileList const &tiles);
+	void drawInstances(GLuint buffer, size_t keyOffset, size_t colorOffset, GLsizei stride, size_t count);
+};
@@ -0,0 +1,143 @@
+#include "TileSlotBuffer.h"
+#include <algorithm>
+
+// Free slots are only compacted away once there are this many, and more of
+// them than live ones
+constexpr size_t MIN_COMPACT_SLOTS = 4096;
+// Dirty slots this close together go up in one glBufferSubData
+constexpr uint32_t MAX_UPLOAD_GAP = 16;
+
+TileSlotBuffer::~TileSlotBuffer()
+{
+	if (_buffer)
+		glDeleteBuffers(1, &_buffer);
+}
+
+// Matches the slots to this frame's tiles and uploads what changed
+void TileSlotBuffer::update(TileList const &tiles)
+	{
+	++_frame;
+	_stats = {};
+	_stats.tiles = int(tiles.size());
+	_dirtyKeys.clear();
+	_dirtyColors.clear();
+
+	for (auto &tile : tiles)
+		{
+		if (auto found = _slotOfKey.find(tile.Key))
+			{
+			auto slot = *found;
+			_slotFrame[slot] = _frame;
+			if (_colors[slot] != tile.PackedColor)
+				{
+				_colors[slot] = tile.PackedColor;
+				_dirtyColors.push_back(slot);
+				++_stats.recolored;
+				}
+			continue;
+			}
+
+		uint32_t slot;
+		if (!_freeSlots.empty())
+			{
+			slot = _freeSlots.back();
+			_freeSlots.pop_back();
+			}
+		else
+			{
+			slot = uint32_t(_keys.size());
+			_keys.emplace_back();
+			_colors.emplace_back();
+			_slotFrame.emplace_back();
+			}
+		_keys[slot] = tile.Key;
+		_colors[slot] = tile.PackedColor;
+		_slotFrame[slot] = _frame;
+		_slotOfKey.insert(tile.Key, slot);
+		_dirtyKeys.push_back(slot);
+		_dirtyColors.push_back(slot);
+		++_stats.added;
+		}
+
+	// Anything live that wasn't seen this frame is gone; only the key needs
+	// to go up, it's what hides the slot
+	for (uint32_t slot = 0; slot < _keys.size(); ++slot)
+		{
+		if (_slotFrame[slot] == _frame || _keys[slot] == RETIRED_TILE_KEY)
+			continue;
+
+		_slotOfKey.erase(_keys[slot]);
+		_keys[slot] = RETIRED_TILE_KEY;
+		_freeSlots.push_back(slot);
+		_dirtyKeys.push_back(slot);
+		++_stats.removed;
+		}
+
+	if (_freeSlots.size() >= MIN_COMPACT_SLOTS && _freeSlots.size() > tiles.size())
+		rebuild(tiles);
+
+	upload();
+	_stats.slots = int(_keys.size());
+	}
+
+// Packs the tiles into the first slots and drops the free ones
+void TileSlotBuffer::rebuild(TileList const &tiles)
+	{
+	_keys.resize(tiles.size());
+	_colors.resize(tiles.size());
+	_slotFrame.assign(tiles.size(), _frame);
+	_freeSlots.clear();
+	_slotOfKey.clear();
+	for (uint32_t slot = 0; slot < tiles.size(); ++slot)
+		{
+		_keys[slot] = tiles[slot].Key;
+		_colors[slot] = tiles[slot].PackedColor;
+		_slotOfKey.insert(tiles[slot].Key, slot);
+		}
+	_stats.rebuilt = true;
+	}
+
+void TileSlotBuffer::upload()
+	{
+	if (!_buffer)
+		glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+
+	if (_keys.size() > _capacity || _stats.rebuilt)
+		{
+		_capacity = std::max({ _keys.size() + _keys.size() / 2, _capacity, MIN_COMPACT_SLOTS });
+		glBufferData(GL_ARRAY_BUFFER, _capacity * (sizeof(uint64_t) + sizeof(uint32_t)), nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, keyOffset(), _keys.size() * sizeof(uint64_t), _keys.data());
+		glBufferSubData(GL_ARRAY_BUFFER, colorOffset(), _colors.size() * sizeof(uint32_t), _colors.data());
+		_stats.bytesUploaded = _keys.size() * (sizeof(uint64_t) + sizeof(uint32_t));
+		_stats.uploads = 2;
+		_stats.rebuilt = true;
+		}
+	else
+		{
+		uploadSlots(keyOffset(), _keys, _dirtyKeys);
+		uploadSlots(colorOffset(), _colors, _dirtyColors);
+		}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+// Sorted, neighbouring dirty slots go up together along with the few clean
+// ones between them
+template <class T>
+void TileSlotBuffer::uploadSlots(size_t offset, std::vector<T> const &values, std::vector<uint32_t> &dirty)
+	{
+	std::sort(dirty.begin(), dirty.end());
+	for (size_t i = 0; i < dirty.size(); )
+		{
+		auto first = dirty[i],
+			last = first;
+		for (++i; i < dirty.size() && dirty[i] - last <= MAX_UPLOAD_GAP; ++i)
+			last = dirty[i];
+
+		auto count = last - first + 1;
+		glBufferSubData(GL_ARRAY_BUFFER, offset + first * sizeof(T), count * sizeof(T), &values[first]);
+		_stats.bytesUploaded += count * sizeof(T);
+		++_stats.uploads;
+		}
+	}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "GLPlatform.h"
+#include "TileKeyMap.h"
+#include "Types.h"
+
+// Written over retired slots; its depth bits are out of range, which the
+// tile vertex shader collapses to nothing
+constexpr uint64_t RETIRED_TILE_KEY = NO_TILE_KEY;
+
+// What the last TileSlotBuffer::update changed
+struct SlotStats
+	{
+	int tiles;
+	int slots;				// drawn, live and retired
+	int added;
+	int removed;
+	int recolored;
+	size_t bytesUploaded;
+	int uploads;			// glBufferSubData calls
+	bool rebuilt;			// grown or compacted, everything was uploaded
+	};
+
+// Keeps the drawn tiles in a GPU buffer of fixed slots, one per tile key,
+// so a frame only uploads the tiles that appeared, disappeared or changed
+// colour. Freed slots are reused for new tiles; when too many pile up the
+// live tiles are packed to the front again.
+//
+// The colour depends on the tile's projected size and so changes far more
+// often than the set of tiles does; keys and colours are kept in separate
+// parts of the buffer so a recoloured tile only uploads its 4 colour bytes.
+class TileSlotBuffer
+{
+public:
+	~TileSlotBuffer();
+
+	void update(TileList const &tiles);
+
+	GLuint buffer() const { return _buffer; }
+	size_t keyOffset() const { return 0; }	// uint64_t tile keys
+	size_t colorOffset() const { return _capacity * sizeof(uint64_t); }	// uint32_t packed colours
+	int slotCount() const { return int(_keys.size()); }
+	SlotStats const &stats() const { return _stats; }
+
+private:
+	GLuint _buffer = 0;
+	size_t _capacity = 0;	// slots the GL buffer holds
+	std::vector<uint64_t> _keys;		// copy of the buffer contents
+	std::vector<uint32_t> _colors;
+	std::vector<uint32_t> _slotFrame;	// last frame each slot's tile was seen
+	std::vector<uint32_t> _freeSlots;
+	std::vector<uint32_t> _dirtyKeys,
+		_dirtyColors;
+	TileKeyMap _slotOfKey;
+	uint32_t _frame = 0;
+	SlotStats _stats = {};
+
+	void rebuild(TileList const &tiles);
+	void upload();
+	template <class T> void uploadSlots(size_t offset, std::vector<T> const &values, std::vector<uint32_t> &dirty);
+};
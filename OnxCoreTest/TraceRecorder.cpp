@@ -0,0 +1,158 @@
+#include "TraceRecorder.h"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+	{
+	constexpr int GPU_TRACK = 0;	// thread ids count from 1
+	constexpr size_t INITIAL_EVENTS = 1 << 16;
+
+	struct ThreadBuffer
+		{
+		int id;
+		std::string name;
+		std::vector<TraceEvent> events;
+		};
+
+	// Owned here rather than by the threads so their events outlive them
+	std::mutex buffersLock;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	std::vector<TraceCamera> frameCameras;	// by frame, only the frame thread touches it
+	thread_local ThreadBuffer *threadBuffer = nullptr;
+	thread_local int cameraFrame = -1;	// see setThreadCameraFrame
+
+	ThreadBuffer &currentBuffer()
+		{
+		if (!threadBuffer)
+			{
+			std::lock_guard<std::mutex> lock(buffersLock);
+			buffers.emplace_back(new ThreadBuffer());
+			threadBuffer = buffers.back().get();
+			threadBuffer->id = int(buffers.size());
+			threadBuffer->name = "thread " + std::to_string(threadBuffer->id);
+			}
+		return *threadBuffer;
+		}
+
+	// Reserved on the first event rather than when the thread is named, so
+	// threads cost nothing while recording is off
+	void append(TraceEvent const &event)
+		{
+		auto &events = currentBuffer().events;
+		if (events.capacity() == 0)
+			events.reserve(INITIAL_EVENTS);
+		events.push_back(event);
+		}
+
+	void writeName(FILE *file, int id, char const *name, bool &first)
+		{
+		fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",", id, name);
+		first = false;
+		}
+	}
+
+std::atomic<bool> TraceRecorder::_enabled { false };
+std::atomic<int> TraceRecorder::_frame { -1 };
+TraceRecorder::Clock::time_point TraceRecorder::_start;
+
+void TraceRecorder::start()
+	{
+	_start = Clock::now();
+	_enabled.store(true, std::memory_order_relaxed);
+	}
+
+int64_t TraceRecorder::now()
+	{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count();
+	}
+
+void TraceRecorder::record(char const *name, char const *category, int64_t start, int64_t end)
+	{
+	if (!enabled())
+		return;
+
+	auto current = frame();
+	TraceEvent event = { name, category, start, end - start, current, cameraFrame >= 0 ? cameraFrame : current, false };
+	append(event);
+	}
+
+// GPU timer results only give a duration, and arrive a frame or so late;
+// start is where the CPU issued the work
+void TraceRecorder::recordGpu(char const *name, int64_t start, int64_t duration, int frame)
+	{
+	if (!enabled())
+		return;
+
+	TraceEvent event = { name, "gpu", start, duration, frame, frame, true };
+	append(event);
+	}
+
+// Works whether or not recording has started, threads are often created
+// before it is
+void TraceRecorder::setThreadName(std::string const &name)
+	{
+	currentBuffer().name = name;
+	}
+
+void TraceRecorder::setThreadCameraFrame(int frame)
+	{
+	cameraFrame = frame;
+	}
+
+int TraceRecorder::threadCameraFrame()
+	{
+	return cameraFrame;
+	}
+
+void TraceRecorder::beginFrame()
+	{
+	if (!enabled())
+		return;
+
+	// Until setFrameCamera says otherwise, the last frame's camera
+	frameCameras.push_back(frameCameras.empty() ? TraceCamera() : frameCameras.back());
+	_frame.store(int(frameCameras.size()) - 1, std::memory_order_relaxed);
+	}
+
+void TraceRecorder::setFrameCamera(TraceCamera const &camera)
+	{
+	if (enabled() && !frameCameras.empty())
+		frameCameras.back() = camera;
+	}
+
+// Stops recording and writes everything recorded so far. Threads that
+// might still be recording should be idle or stopped first.
+bool TraceRecorder::write(char const *path)
+	{
+	_enabled.store(false, std::memory_order_relaxed);
+
+	auto file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(buffersLock);
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	auto first = true;
+	writeName(file, GPU_TRACK, "GPU", first);
+	for (auto &buffer : buffers)
+		{
+		writeName(file, buffer->id, buffer->name.c_str(), first);
+		for (auto &event : buffer->events)
+			{
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				event.Name, event.Category, event.Gpu ? GPU_TRACK : buffer->id, event.Start * 0.001, event.Duration * 0.001);
+			if (event.Frame >= 0)
+				{
+				auto &camera = frameCameras[event.CameraFrame];
+				fprintf(file, ",\"args\":{\"frame\":%d,\"cameraFrame\":%d,\"orbitXZ\":%g,\"orbitYZ\":%g,\"distance\":%g,\"detail\":%g}",
+					event.Frame, event.CameraFrame, camera.OrbitXZ, camera.OrbitYZ, camera.Distance, camera.Detail);
+				}
+			fprintf(file, "}");
+			}
+		}
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+	}
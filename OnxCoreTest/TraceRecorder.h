@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// The orbit camera as a trace sees it, attached to every span working on its frame
+struct TraceCamera
+	{
+	float OrbitXZ;
+	float OrbitYZ;
+	float Distance;
+	float Detail;
+	};
+
+// A span on the timeline; names and categories must be string literals,
+// only the pointer is kept
+struct TraceEvent
+	{
+	char const *Name;
+	char const *Category;
+	int64_t Start;		// nanoseconds since start()
+	int64_t Duration;
+	int Frame;			// -1 before the first frame
+	int CameraFrame;	// the frame whose camera the span worked on, usually Frame
+	bool Gpu;			// drawn on the GPU track rather than the recording thread's
+	};
+
+// Records spans into per thread buffers and writes them out as Chrome Trace
+// Event JSON, for chrome://tracing or Perfetto. Threads only ever append to
+// their own buffer, so recording takes no locks; a thread takes a lock once,
+// the first time it records. Static, so the task pool and generation thread
+// can record without a recorder threaded through to them.
+class TraceRecorder
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static void start();
+	static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+	static bool write(char const *path);
+
+	static int64_t now();
+	static void record(char const *name, char const *category, int64_t start, int64_t end);
+	static void recordGpu(char const *name, int64_t start, int64_t duration, int frame);
+	static void setThreadName(std::string const &name);
+	// For threads working on an older frame's camera, like the generation
+	// thread: their spans take that frame's camera; -1 follows frame()
+	static void setThreadCameraFrame(int frame);
+	static int threadCameraFrame();
+
+	// Called from the thread driving the frames
+	static void beginFrame();
+	static void setFrameCamera(TraceCamera const &camera);
+	static int frame() { return _frame.load(std::memory_order_relaxed); }
+
+private:
+	static std::atomic<bool> _enabled;
+	static std::atomic<int> _frame;
+	static Clock::time_point _start;
+};
+
+// Records a span covering the rest of the scope
+class TraceScope
+{
+public:
+	TraceScope(char const *name, char const *category) :
+		  _name(name)
+		, _category(category)
+		, _start(TraceRecorder::enabled() ? TraceRecorder::now() : -1)
+		{
+		}
+	~TraceScope()
+		{
+		if (_start >= 0)
+			TraceRecorder::record(_name, _category, _start, TraceRecorder::now());
+		}
+
+private:
+	char const *_name,
+		*_category;
+	int64_t _start;
+};
@@ -1,18 +1,95 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 #include <glm.hpp>
+#include <gtc/bitfield.hpp>
+#include "FrameMemory.h"
 
+constexpr int MAX_SUBDIVISION_DEPTH = 20;
+constexpr int TILE_KEY_DEPTH_BITS = 5;
+constexpr float ROOT_HALF_SIZE = 5.f; // the root quad spans -5..5 on x and y
+
+// Tiles are identified by a quadkey: the Morton interleaved x/y cell of the
+// tile at its depth, above the depth in the low TILE_KEY_DEPTH_BITS. Cells
+// count from the root's minimum corner.
+inline uint64_t makeTileKey(glm::uvec2 const &cell, int depth)
+	{
+	return (glm::bitfieldInterleave(cell.x, cell.y) << TILE_KEY_DEPTH_BITS) | uint64_t(depth);
+	}
+
+// Quad corners below the root are exact binary fractions of it, so the
+// cell index this computes is exact as well
+inline glm::uvec2 tileCell(glm::vec2 const &p1, glm::vec2 const &p2, int depth)
+	{
+	auto cellsPerUnit = float(1u << depth) * (0.5f / ROOT_HALF_SIZE);
+	auto lo = (glm::min(p1, p2) + ROOT_HALF_SIZE) * cellsPerUnit + 0.5f;
+	return glm::uvec2(glm::ivec2(lo));
+	}
+
+inline uint64_t makeTileKey(glm::vec2 const &p1, glm::vec2 const &p2, int depth)
+	{
+	return makeTileKey(tileCell(p1, p2, depth), depth);
+	}
+
+inline int tileKeyDepth(uint64_t key)
+	{
+	return int(key & ((1u << TILE_KEY_DEPTH_BITS) - 1));
+	}
+
+inline glm::uvec2 tileKeyCell(uint64_t key)
+	{
+	return glm::uvec2(glm::bitfieldDeinterleave(key >> TILE_KEY_DEPTH_BITS));
+	}
+
+// Same layout as glm::packUnorm4x8 (x in the low byte) for components that
+// are already in 0..1; skips its clamp and round() call, this runs per tile
+inline uint32_t packTileColor(glm::vec4 const &color)
+	{
+	auto bytes = glm::uvec4(glm::ivec4(color * 255.f + 0.5f));
+	return bytes.x | (bytes.y << 8) | (bytes.z << 16) | (bytes.w << 24);
+	}
+
+// A generated tile: its key and a packed colour, the corners are derived from
+// the key when they're needed
 struct Tile
 	{
-	glm::vec2 P1;
-	glm::vec2 P2;
-	float Alpha;
-	int LoD;
-	glm::vec4 Color;
+	uint64_t Key;
+	uint32_t PackedColor;
 
-	Tile(glm::vec2 const &p1, glm::vec2 const &p2, glm::vec4 const &color)
+	Tile(glm::vec2 const &p1, glm::vec2 const &p2, int depth, glm::vec4 const &color)
 		{
-		P1 = p1;
-		P2 = p2;
-		Color = color;
+		Key = makeTileKey(p1, p2, depth);
+		PackedColor = packTileColor(color);
 		}
+
+	int Depth() const { return tileKeyDepth(Key); }
+	float Size() const { return 2.f * ROOT_HALF_SIZE / float(1u << Depth()); }
+	glm::vec2 P1() const { return glm::vec2(tileKeyCell(Key)) * Size() - ROOT_HALF_SIZE; }
+	glm::vec2 P2() const { return P1() + Size(); }
+	glm::vec4 Color() const { return glm::unpackUnorm4x8(PackedColor); }
+	};
+
+static_assert(sizeof(Tile) <= 16, "Tile records are meant to stay compact");
+
+// Tile lists run to megabytes at high detail, see PageAllocator
+typedef std::vector<Tile, PageAllocator<Tile>> TileList;
+
+// Generate colors, a gradient from blue->green as depth increases and
+// red increasing as the subdivided quad increases in projected size
+inline glm::vec4 makeTileColor(float depth, float length, float detail)
+	{
+	float scaled = depth / float(MAX_SUBDIVISION_DEPTH);
+	return glm::vec4(scaled, std::max(1.f - (length / detail), 0.f), 1.0f - scaled, 1);
+	}
+
+// What the tile generators need to know about the camera for one frame
+struct CameraState
+	{
+	glm::mat4x4 ViewProj;
+	glm::vec3 Position;
+	glm::vec3 Focus;
+	glm::vec2 TanHalfFov;	// x and y, from the projection matrix
+	float FarClip;
+	float Detail;
 	};
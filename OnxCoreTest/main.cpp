@@ -6,10 +6,16 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 
 #include "OpenglWindow.h"
+#include "TraceRecorder.h"
 
 OpenglWindow* oglWindow;
+char const *tracePath = nullptr;
+std::chrono::steady_clock::time_point replayStart;
 
 //hooks into the main glut events we use to trigger and control things
 int frameRate = 16; //ms
@@ -19,6 +25,21 @@ void frameTimer(int timeVal)
 	glutTimerFunc(frameRate, frameTimer, timeVal + frameRate);
 }
 
+//replays draw frame after frame as fast as they can, the input is tied to frames rather than time
+void replayIdle()
+{
+	if (!oglWindow->replayFinished())
+	{
+		glutPostRedisplay();
+		return;
+	}
+
+	auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replayStart).count();
+	printf("replayed %d frames in %.1f ms, %.3f ms a frame\n", oglWindow->frame(), ms, ms / std::max(oglWindow->frame(), 1));
+	glutIdleFunc(nullptr);
+	glutLeaveMainLoop();
+}
+
 void Render()
 {
 	oglWindow->Render();
@@ -26,6 +47,15 @@ void Render()
 
 void Exit()
 {
+	if (!oglWindow)
+		return;
+
+	//the window goes first so the generation thread has stopped recording
+	//and the input log is closed off
+	delete oglWindow;
+	oglWindow = nullptr;
+	if (tracePath && !TraceRecorder::write(tracePath))
+		fprintf(stderr, "could not write %s\n", tracePath);
 }
 
 void mouseMoveListen(int x, int y)
@@ -46,20 +76,32 @@ int main(int argc, char* argv[])
 	//double buffer, RGBA color
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
 
+	//--core-profile asks for a 3.3 core context, tiles are then always drawn instanced
+	bool coreProfile = false;
+	for (int i = 1; i < argc; ++i)
+		coreProfile |= strcmp(argv[i], "--core-profile") == 0;
+	if (coreProfile)
+	{
+		glutInitContextVersion(3, 3);
+		glutInitContextProfile(GLUT_CORE_PROFILE);
+	}
+
 	//basic window setup
 	glutInitWindowSize(1280, 720);
 	glutInitWindowPosition(100, 100);
 	glutCreateWindow("Enter Name");
 
-	//check that glew is good to go as well
+	//check that glew is good to go as well, it needs to be told to look past
+	//glGetString(GL_EXTENSIONS) in a core context
+	glewExperimental = coreProfile ? GL_TRUE : GL_FALSE;
 	GLenum res = glewInit();
 	if (res != GLEW_OK)
 	{
 		fprintf(stderr, "Error: '%s'\n", glewGetErrorString(res));
 		return 1;
 	}
+	glGetError(); //and that leaves a GL_INVALID_ENUM behind in core contexts
 
-	glutTimerFunc(0, frameTimer, 0);
 	glutDisplayFunc(Render);
 	glutPassiveMotionFunc(mouseMoveListen);
 	glutMotionFunc(mouseMoveListen);
@@ -71,6 +113,109 @@ int main(int argc, char* argv[])
 
 	oglWindow = new OpenglWindow();
 
+	//optional traversal tuning: --threads N, --parallel-depth N, --batched, --incremental, --frustum-planes,
+	//--budgeted with --budget-tiles N and/or --budget-us N, --async to generate tiles off the display callback,
+	//--delta-instances to upload only the tiles that changed rather than every tile every frame,
+	//--immediate to draw tiles with glBegin/glEnd instead of instancing,
+	//--profile to show where each frame's time goes, --profile-csv FILE to log it,
+	//--trace FILE to record a Chrome trace of the frames, worker tasks and GPU times, written on exit,
+	//--record-input FILE to log the mouse input, --replay-input FILE to rerun a log in place of the mouse
+	//(bit for bit, as long as --async isn't used), --huge-pages to back the large tile lists with huge pages,
+	//--terrain to lay the tiles over procedural hills, --pyramid FILE to lay them over a tile pyramid
+	//from OnxPyramidBuilder, --loader after it to refine only into pyramid tiles loaded in the background,
+	//--core-profile for a 3.3 core context (read above, before the window is made)
+	int tileBudget = 0, timeBudget = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			oglWindow->tileGenerator().setTraversalThreads(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--parallel-depth") == 0 && i + 1 < argc)
+			oglWindow->tileGenerator().setParallelDepth(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--batched") == 0)
+			oglWindow->tileGenerator().setTraversalMode(TraversalMode::Batched);
+		else if (strcmp(argv[i], "--incremental") == 0)
+			oglWindow->tileGenerator().setTraversalMode(TraversalMode::Incremental);
+		else if (strcmp(argv[i], "--frustum-planes") == 0)
+			oglWindow->tileGenerator().setCullMode(CullMode::FrustumPlanes);
+		else if (strcmp(argv[i], "--budgeted") == 0)
+			oglWindow->tileGenerator().setTraversalMode(TraversalMode::Budgeted);
+		else if (strcmp(argv[i], "--budget-tiles") == 0 && i + 1 < argc)
+			tileBudget = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--budget-us") == 0 && i + 1 < argc)
+			timeBudget = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--async") == 0)
+			oglWindow->tileGenerator().setAsyncGeneration(true);
+		else if (strcmp(argv[i], "--huge-pages") == 0)
+			setHugePages(true);
+		else if (strcmp(argv[i], "--terrain") == 0)
+		{
+			auto heightfield = std::make_shared<Heightfield const>(ProceduralTerrain());
+			oglWindow->tileGenerator().setHeightfield(heightfield);
+			oglWindow->tileRenderer().setHeightfield(heightfield);
+		}
+		else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc)
+		{
+			// culled against the whole pyramid, drawn on about a heightfield's worth of it
+			auto pyramid = std::make_shared<TilePyramid>();
+			if (!pyramid->open(argv[++i]))
+			{
+				fprintf(stderr, "could not open tile pyramid %s\n", argv[i]);
+				return 1;
+			}
+			oglWindow->tileGenerator().setTilePyramid(pyramid);
+			oglWindow->tileRenderer().setHeightfield(std::make_shared<Heightfield const>(PyramidLevel(*pyramid, pyramid->depthForCells(1 << DEFAULT_HEIGHTFIELD_LEVELS))));
+		}
+		else if (strcmp(argv[i], "--loader") == 0)
+		{
+			// refines only into the pyramid tiles loaded so far
+			if (!oglWindow->tileGenerator().tilePyramid())
+			{
+				fprintf(stderr, "--loader needs a --pyramid before it\n");
+				return 1;
+			}
+			auto source = std::make_shared<PyramidTileSource const>(oglWindow->tileGenerator().tilePyramid());
+			oglWindow->tileGenerator().setTileLoader(std::make_shared<TileLoader>(source, size_t(DEFAULT_LOAD_BUDGET_MB) << 20, DEFAULT_LOAD_THREADS));
+		}
+		else if (strcmp(argv[i], "--delta-instances") == 0)
+			oglWindow->tileRenderer().setRenderMode(RenderMode::DeltaInstanced);
+		else if (strcmp(argv[i], "--immediate") == 0)
+			oglWindow->tileRenderer().setRenderMode(RenderMode::Immediate);
+		else if (strcmp(argv[i], "--profile") == 0)
+			oglWindow->setProfileOverlay(true);
+		else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+		{
+			if (!oglWindow->profiler().openLog(argv[++i]))
+				fprintf(stderr, "could not open %s\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (strcmp(argv[i], "--record-input") == 0 && i + 1 < argc)
+		{
+			if (!oglWindow->recordInput(argv[++i]))
+				fprintf(stderr, "could not open %s\n", argv[i]);
+		}
+		else if (strcmp(argv[i], "--replay-input") == 0 && i + 1 < argc)
+		{
+			if (!oglWindow->replayInput(argv[++i]))
+				return 1;
+		}
+	}
+	if (tracePath)
+	{
+		TraceRecorder::setThreadName("main");
+		TraceRecorder::start();
+		oglWindow->profiler().setEnabled(true);
+	}
+	oglWindow->tileGenerator().setRefineBudget(tileBudget, timeBudget);
+
+	if (oglWindow->replaying())
+	{
+		replayStart = std::chrono::steady_clock::now();
+		glutIdleFunc(replayIdle);
+	}
+	else
+		glutTimerFunc(0, frameTimer, 0);
+
 	//so it begins...
 	glutMainLoop();
 